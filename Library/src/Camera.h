@@ -1,5 +1,6 @@
 #pragma once
 #include <cassert>
+#include <cstring>
 #include <SDL_keyboard.h>
 #include <SDL_mouse.h>
 
@@ -34,6 +35,9 @@ namespace dae
 		float nearPlane{ 0.1f };
 		float farPlane{ 100.f };
 
+		// Bumped whenever the view or projection matrix changes
+		uint32_t version{};
+
 		void Initialize(float _fovAngle = 90.f, Vector3 _origin = {0.f,0.f,0.f}, float _aspectRatio = 1.66f)
 		{
 			fovAngle = _fovAngle;
@@ -55,8 +59,13 @@ namespace dae
 			right = Vector3::Cross(Vector3::UnitY, forward).Normalized();
 			up = Vector3::Cross(forward, right).Normalized();
 
+			const Matrix previousViewMatrix{ viewMatrix };
+
 			invViewMatrix = Matrix(right, up, forward, origin);
 			viewMatrix = invViewMatrix.Inverse();
+
+			// Bitwise, Matrix::operator== would let slow steady motion pass as unchanged frame after frame
+			if (std::memcmp(&viewMatrix, &previousViewMatrix, sizeof(Matrix)) != 0) ++version;
 		}
 
 		void CalculateProjectionMatrix()
@@ -67,6 +76,8 @@ namespace dae
 				Vector4{ 0,                         0,         farPlane / (farPlane - nearPlane),                1 },
 				Vector4{ 0,                         0,         -(farPlane * nearPlane) / (farPlane - nearPlane), 0 },
 			};
+
+			++version;
 		}
 
 		void Update(const Timer* pTimer)
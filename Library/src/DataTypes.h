@@ -1,4 +1,5 @@
 #pragma once
+#include <cstring>
 #include "Maths.h"
 #include "Texture.h"
 #include "vector"
@@ -20,9 +21,86 @@ namespace dae
 		Vector4 position{};
 		ColorRGB color{ colors::White };
 		Vector2 uv{};
-		Vector3 normal{};
-		Vector3 tangent{};
-		Vector3 viewDirection{};
+
+		// World space directions, see PackOctahedral
+		uint32_t normal{};
+		uint32_t tangent{};
+
+		// Shaders derive the view direction from it, so a camera move only has to update position
+		Vector3 worldPosition{};
+	};
+
+	// Vertex components the transform reads, one array per component so they can be loaded several vertices at a time
+	struct VertexStreams
+	{
+		std::vector<float> positionX{};
+		std::vector<float> positionY{};
+		std::vector<float> positionZ{};
+		std::vector<float> normalX{};
+		std::vector<float> normalY{};
+		std::vector<float> normalZ{};
+		std::vector<float> tangentX{};
+		std::vector<float> tangentY{};
+		std::vector<float> tangentZ{};
+
+		size_t Size() const { return positionX.size(); }
+	};
+
+	// Transformed positions, laid out like VertexStreams
+	struct PositionStreams
+	{
+		std::vector<float> x{};
+		std::vector<float> y{};
+		std::vector<float> z{};
+
+		void Resize(size_t size)
+		{
+			x.resize(size);
+			y.resize(size);
+			z.resize(size);
+		}
+
+		size_t Size() const { return x.size(); }
+	};
+
+	// Object space bounds, computed when the mesh is loaded
+	struct MeshBounds
+	{
+		Vector3 min{};
+		Vector3 max{};
+
+		// Centered on the box, with the radius of the farthest vertex from there
+		Vector3 center{};
+		float radius{};
+	};
+
+	// Cluster of neighbouring triangles that owns a contiguous range of the mesh's vertices and indices,
+	// so it can be culled and transformed on its own
+	struct Meshlet
+	{
+		uint32_t vertexOffset{};
+		uint32_t vertexCount{};
+		uint32_t indexOffset{};
+		uint32_t indexCount{};
+
+		MeshBounds bounds{};
+
+		// Every face normal lies within coneCutoff = sin(half angle) of coneAxis. Above 1 when the normals spread
+		// too far for the cone to ever cull the meshlet.
+		Vector3 coneAxis{};
+		float coneCutoff{ 2.f };
+
+		// Versions of the world matrix and camera the meshlet's vertices were transformed with
+		uint32_t transformedWorldVersion{ UINT32_MAX };
+		uint32_t transformedCameraVersion{ UINT32_MAX };
+	};
+
+	// Simplified index buffer over the mesh's own vertices. error is the furthest any original vertex lies from the simplified
+	// surface, in object space units.
+	struct MeshLod
+	{
+		std::vector<uint32_t> indices{};
+		float error{};
 	};
 
 	enum class PrimitiveTopology
@@ -39,8 +117,54 @@ namespace dae
 
 		size_t materialId{};
 
+		MeshBounds bounds{};
+
+		// Empty unless the mesh was split with MeshOptimizer::BuildMeshlets, it is culled and transformed as a whole then
+		std::vector<Meshlet> meshlets{};
+
+		// Coarser versions of indices, from fine to coarse, see MeshSimplifier::BuildLods
+		std::vector<MeshLod> lods{};
+
+		VertexStreams vertexStreams{};
+		PositionStreams worldPositions{};
 		std::vector<Vertex_Out> verticesOut{};
+		std::vector<Vector4> clipPositions{};
+		std::vector<uint8_t> clipFlags{};
+
+		// What the material's shader made of verticesOut, a fixed number of floats per vertex set by the renderer
+		std::vector<float> varyingsOut{};
+
+		// Versions of the world matrix and camera the transformed vertices were computed with
+		uint32_t transformedWorldVersion{ UINT32_MAX };
+		uint32_t transformedCameraVersion{ UINT32_MAX };
+
+		void SetWorldMatrix(const Matrix& matrix)
+		{
+			// Bitwise, any change at all has to invalidate the cached vertices
+			if (std::memcmp(&matrix, &m_WorldMatrix, sizeof(Matrix)) == 0) return;
+
+			m_WorldMatrix = matrix;
+			++m_WorldVersion;
+		}
+
+		const Matrix& GetWorldMatrix() const { return m_WorldMatrix; }
+		uint32_t GetWorldVersion() const { return m_WorldVersion; }
+
+	private:
+		// Only written through SetWorldMatrix, which keeps the version in step
+		Matrix m_WorldMatrix{};
+
+		// Bumped whenever the world matrix changes, so the transform knows when its cached results are stale
+		uint32_t m_WorldVersion{};
+	};
+
+	// One placement of a mesh that is drawn many times, the mesh's vertices and indices are shared by all of them
+	struct MeshInstance
+	{
 		Matrix worldMatrix{};
+
+		// Multiplied into the vertex colors, which tint the diffuse map
+		ColorRGB color{ colors::White };
 	};
 
 	class Material
@@ -50,5 +174,8 @@ namespace dae
 		Texture* pNormal;
 		Texture* pSpecular;
 		Texture* pGloss;
+
+		// Index into the renderer's shader list
+		size_t shaderId{};
 	};
 }
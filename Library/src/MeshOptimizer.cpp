@@ -0,0 +1,448 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	// Forsyth's scoring parameters, the cache here is a simulated LRU cache
+	constexpr int SCORE_CACHE_SIZE{ 32 };
+	constexpr float CACHE_DECAY_POWER{ 1.5f };
+	constexpr float LAST_TRIANGLE_SCORE{ 0.75f };
+	constexpr float VALENCE_BOOST_SCALE{ 2.f };
+	constexpr float VALENCE_BOOST_POWER{ 0.5f };
+
+	// Trades new vertices against normal spread when growing a meshlet, one vertex weighs as much as this many
+	// triangles facing perpendicular to the meshlet
+	constexpr float MESHLET_CONE_WEIGHT{ 1.f };
+
+	struct PositionHash
+	{
+		size_t operator()(const Vector3& position) const
+		{
+			size_t hash{ std::hash<float>{}(position.x) };
+			hash ^= std::hash<float>{}(position.y) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			hash ^= std::hash<float>{}(position.z) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			return hash;
+		}
+	};
+
+	// Exact, unlike Vector3's operator==, so it agrees with PositionHash
+	struct PositionEqual
+	{
+		bool operator()(const Vector3& a, const Vector3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+
+	struct VertexData
+	{
+		int cachePosition{ -1 };
+		uint32_t remainingTriangles{};
+		float score{};
+	};
+
+	// Triangles using each vertex, as one flat list where vertex v's triangles are in [offsets[v], offsets[v + 1])
+	struct TriangleAdjacency
+	{
+		std::vector<uint32_t> offsets{};
+		std::vector<uint32_t> triangles{};
+	};
+
+	TriangleAdjacency BuildTriangleAdjacency(const std::vector<uint32_t>& indices, size_t vertexCount)
+	{
+		TriangleAdjacency adjacency{ std::vector<uint32_t>(vertexCount + 1, 0), std::vector<uint32_t>(indices.size()) };
+
+		for (const uint32_t index : indices)
+		{
+			++adjacency.offsets[index + 1];
+		}
+		for (size_t i{ 1 }; i <= vertexCount; ++i)
+		{
+			adjacency.offsets[i] += adjacency.offsets[i - 1];
+		}
+
+		std::vector<uint32_t> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		for (size_t i{ 0 }; i < indices.size(); ++i)
+		{
+			adjacency.triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		return adjacency;
+	}
+
+	float ScoreVertex(const VertexData& vertex)
+	{
+		// No triangles left to add, the vertex should not pull anything in anymore
+		if (vertex.remainingTriangles == 0) return -1.f;
+
+		float score{};
+		if (vertex.cachePosition >= 0)
+		{
+			// The three vertices of the last triangle get a fixed score, so the next one doesn't just reuse its edge
+			if (vertex.cachePosition < 3)
+			{
+				score = LAST_TRIANGLE_SCORE;
+			}
+			else
+			{
+				const float scaler{ 1.f / (SCORE_CACHE_SIZE - 3) };
+				score = std::pow(1.f - (vertex.cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+			}
+		}
+
+		// Favour vertices with few triangles left, so lone triangles don't get left behind
+		score += VALENCE_BOOST_SCALE * std::pow(static_cast<float>(vertex.remainingTriangles), -VALENCE_BOOST_POWER);
+		return score;
+	}
+}
+
+float MeshOptimizer::ComputeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize)
+{
+	if (indices.size() < 3) return 0.f;
+
+	// Timestamp of each vertex entering the FIFO, it is still cached while fewer than cacheSize misses happened since
+	std::vector<size_t> cachedAt(vertexCount, 0);
+	size_t misses{ 0 };
+
+	for (const uint32_t index : indices)
+	{
+		if (cachedAt[index] == 0 || misses - cachedAt[index] >= cacheSize)
+		{
+			++misses;
+			cachedAt[index] = misses;
+		}
+	}
+
+	return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	const size_t triangleCount{ indices.size() / 3 };
+	if (triangleCount == 0) return;
+
+	// Added triangles get swapped to the back of their vertices' ranges, past remainingTriangles
+	TriangleAdjacency adjacency{ BuildTriangleAdjacency(indices, vertexCount) };
+
+	std::vector<VertexData> vertices(vertexCount);
+	for (size_t i{ 0 }; i < vertexCount; ++i)
+	{
+		vertices[i].remainingTriangles = adjacency.offsets[i + 1] - adjacency.offsets[i];
+	}
+
+	for (VertexData& vertex : vertices)
+	{
+		vertex.score = ScoreVertex(vertex);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> isTriangleAdded(triangleCount, false);
+	for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+	{
+		triangleScores[triangle] =
+			vertices[indices[triangle * 3 + 0]].score +
+			vertices[indices[triangle * 3 + 1]].score +
+			vertices[indices[triangle * 3 + 2]].score;
+	}
+
+	std::vector<uint32_t> optimized{};
+	optimized.reserve(indices.size());
+
+	// The cache holds up to three extra entries while a triangle is being added
+	std::vector<uint32_t> cache{};
+	std::vector<uint32_t> nextCache{};
+	cache.reserve(SCORE_CACHE_SIZE + 3);
+	nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+	size_t bestTriangle{ static_cast<size_t>(std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin()) };
+	size_t searchCursor{ 0 };
+
+	for (size_t added{ 0 }; added < triangleCount; ++added)
+	{
+		// Nothing in the cache connects to a remaining triangle, continue with the next unused one in order
+		if (bestTriangle == SIZE_MAX)
+		{
+			while (isTriangleAdded[searchCursor]) ++searchCursor;
+			bestTriangle = searchCursor;
+		}
+
+		isTriangleAdded[bestTriangle] = true;
+
+		const uint32_t* pTriangle{ indices.data() + bestTriangle * 3 };
+		nextCache.assign(pTriangle, pTriangle + 3);
+
+		for (int corner{ 0 }; corner < 3; ++corner)
+		{
+			const uint32_t index{ pTriangle[corner] };
+			optimized.push_back(index);
+
+			// Remove the triangle from the vertex' list of remaining ones
+			VertexData& vertex{ vertices[index] };
+			uint32_t* pBegin{ adjacency.triangles.data() + adjacency.offsets[index] };
+			uint32_t* pEnd{ pBegin + vertex.remainingTriangles };
+			std::iter_swap(std::find(pBegin, pEnd, static_cast<uint32_t>(bestTriangle)), pEnd - 1);
+			--vertex.remainingTriangles;
+		}
+
+		// The triangle's vertices move to the front of the cache, the rest keeps its order
+		for (const uint32_t index : cache)
+		{
+			if (index != pTriangle[0] && index != pTriangle[1] && index != pTriangle[2]) nextCache.push_back(index);
+		}
+		std::swap(cache, nextCache);
+
+		// Rescore everything in the cache, including the entries that just fell out of it
+		for (size_t i{ 0 }; i < cache.size(); ++i)
+		{
+			vertices[cache[i]].cachePosition = i < static_cast<size_t>(SCORE_CACHE_SIZE) ? static_cast<int>(i) : -1;
+		}
+
+		bestTriangle = SIZE_MAX;
+		float bestScore{ -1.f };
+		for (const uint32_t index : cache)
+		{
+			VertexData& vertex{ vertices[index] };
+			const float newScore{ ScoreVertex(vertex) };
+			const float scoreChange{ newScore - vertex.score };
+			vertex.score = newScore;
+
+			const uint32_t* pTriangles{ adjacency.triangles.data() + adjacency.offsets[index] };
+			for (uint32_t i{ 0 }; i < vertex.remainingTriangles; ++i)
+			{
+				const uint32_t triangle{ pTriangles[i] };
+				triangleScores[triangle] += scoreChange;
+
+				if (triangleScores[triangle] > bestScore)
+				{
+					bestScore = triangleScores[triangle];
+					bestTriangle = triangle;
+				}
+			}
+		}
+
+		if (cache.size() > static_cast<size_t>(SCORE_CACHE_SIZE)) cache.resize(SCORE_CACHE_SIZE);
+	}
+
+	indices = std::move(optimized);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	constexpr uint32_t unassigned{ UINT32_MAX };
+	std::vector<uint32_t> remap(vertices.size(), unassigned);
+
+	std::vector<Vertex> reordered{};
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == unassigned)
+		{
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	for (size_t i{ 0 }; i < vertices.size(); ++i)
+	{
+		if (remap[i] == unassigned) reordered.push_back(vertices[i]);
+	}
+
+	vertices = std::move(reordered);
+}
+
+void MeshOptimizer::BuildMeshlets(Mesh& mesh)
+{
+	if (mesh.primitiveTopology != PrimitiveTopology::TriangleList || mesh.indices.empty()) return;
+
+	constexpr uint32_t unassigned{ UINT32_MAX };
+
+	const size_t triangleCount{ mesh.indices.size() / 3 };
+
+	// Seams split vertices that share a position, neighbours are found through the positions so growing doesn't stop there
+	std::vector<uint32_t> vertexPositions(mesh.vertices.size());
+	std::vector<uint32_t> positionIndices(mesh.indices.size());
+	size_t positionCount{ 0 };
+	{
+		std::unordered_map<Vector3, uint32_t, PositionHash, PositionEqual> positionLookup{};
+		for (size_t i{ 0 }; i < mesh.vertices.size(); ++i)
+		{
+			vertexPositions[i] = positionLookup.try_emplace(mesh.vertices[i].position, static_cast<uint32_t>(positionLookup.size())).first->second;
+		}
+
+		for (size_t i{ 0 }; i < mesh.indices.size(); ++i)
+		{
+			positionIndices[i] = vertexPositions[mesh.indices[i]];
+		}
+		positionCount = positionLookup.size();
+	}
+	const TriangleAdjacency adjacency{ BuildTriangleAdjacency(positionIndices, positionCount) };
+
+	// Wound the same way the rasterizer culls, zero for degenerate triangles
+	std::vector<Vector3> faceNormals(triangleCount);
+	for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+	{
+		const Vector3& p0{ mesh.vertices[mesh.indices[triangle * 3 + 0]].position };
+		const Vector3& p1{ mesh.vertices[mesh.indices[triangle * 3 + 1]].position };
+		const Vector3& p2{ mesh.vertices[mesh.indices[triangle * 3 + 2]].position };
+
+		const Vector3 normal{ Vector3::Cross(p1 - p0, p2 - p0) };
+		if (normal.SqrMagnitude() > 0.f) faceNormals[triangle] = normal.Normalized();
+	}
+
+	std::vector<Vertex> vertices{};
+	std::vector<uint32_t> indices{};
+	vertices.reserve(mesh.vertices.size());
+	indices.reserve(mesh.indices.size());
+
+	// Index of each source vertex in the output while it belongs to the current meshlet
+	std::vector<uint32_t> remap(mesh.vertices.size(), unassigned);
+	std::vector<bool> isTriangleAdded(triangleCount, false);
+
+	std::vector<uint32_t> meshletVertices{};
+	std::vector<uint32_t> meshletTriangles{};
+	Vector3 normalSum{};
+
+	mesh.meshlets.clear();
+	Meshlet meshlet{};
+
+	const auto countNewVertices{ [&](size_t triangle)
+		{
+			const uint32_t* pTriangle{ mesh.indices.data() + triangle * 3 };
+
+			size_t count{ 0 };
+			for (int corner{ 0 }; corner < 3; ++corner)
+			{
+				const bool isRepeat{ (corner > 0 && pTriangle[corner] == pTriangle[0]) || (corner > 1 && pTriangle[corner] == pTriangle[1]) };
+				if (remap[pTriangle[corner]] == unassigned && !isRepeat) ++count;
+			}
+			return count;
+		} };
+
+	const auto addTriangle{ [&](size_t triangle)
+		{
+			for (int corner{ 0 }; corner < 3; ++corner)
+			{
+				const uint32_t index{ mesh.indices[triangle * 3 + corner] };
+				if (remap[index] == unassigned)
+				{
+					remap[index] = static_cast<uint32_t>(vertices.size());
+					vertices.push_back(mesh.vertices[index]);
+					meshletVertices.push_back(index);
+				}
+				indices.push_back(remap[index]);
+			}
+
+			isTriangleAdded[triangle] = true;
+			meshletTriangles.push_back(static_cast<uint32_t>(triangle));
+			normalSum += faceNormals[triangle];
+
+			meshlet.vertexCount = static_cast<uint32_t>(meshletVertices.size());
+			meshlet.indexCount += 3;
+		} };
+
+	const auto finishMeshlet{ [&]()
+		{
+			if (meshlet.indexCount == 0) return;
+
+			meshlet.bounds = Utils::ComputeBounds({ vertices.data() + meshlet.vertexOffset, meshlet.vertexCount });
+
+			if (normalSum.SqrMagnitude() > 0.f)
+			{
+				meshlet.coneAxis = normalSum.Normalized();
+
+				float minDot{ 1.f };
+				for (const uint32_t triangle : meshletTriangles)
+				{
+					if (faceNormals[triangle].SqrMagnitude() > 0.f) minDot = std::min(minDot, Vector3::Dot(faceNormals[triangle], meshlet.coneAxis));
+				}
+
+				// Normals spreading past a right angle from the axis can face the camera from anywhere
+				if (minDot > 0.f) meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+			}
+
+			mesh.meshlets.push_back(meshlet);
+
+			for (const uint32_t index : meshletVertices)
+			{
+				remap[index] = unassigned;
+			}
+			meshletVertices.clear();
+			meshletTriangles.clear();
+			normalSum = {};
+
+			meshlet = { static_cast<uint32_t>(vertices.size()), 0, static_cast<uint32_t>(indices.size()), 0 };
+		} };
+
+	size_t searchCursor{ 0 };
+	for (size_t added{ 0 }; added < triangleCount; ++added)
+	{
+		// Grow through triangles sharing a vertex with the meshlet, preferring ones that add few vertices
+		// and face the same way as the meshlet so far, which keeps both the bounds and the normal cone tight
+		size_t bestTriangle{ SIZE_MAX };
+		if (meshletTriangles.size() < MESHLET_MAX_TRIANGLES)
+		{
+			const Vector3 averageNormal{ normalSum.SqrMagnitude() > 0.f ? normalSum.Normalized() : Vector3{} };
+			float bestScore{ FLT_MAX };
+
+			for (const uint32_t vertex : meshletVertices)
+			{
+				const uint32_t position{ vertexPositions[vertex] };
+				for (uint32_t i{ adjacency.offsets[position] }; i < adjacency.offsets[position + 1]; ++i)
+				{
+					const uint32_t triangle{ adjacency.triangles[i] };
+					if (isTriangleAdded[triangle]) continue;
+
+					const size_t newVertices{ countNewVertices(triangle) };
+					if (meshletVertices.size() + newVertices > MESHLET_MAX_VERTICES) continue;
+
+					const float score{ static_cast<float>(newVertices) + MESHLET_CONE_WEIGHT * (1.f - Vector3::Dot(faceNormals[triangle], averageNormal)) };
+					if (score < bestScore)
+					{
+						bestScore = score;
+						bestTriangle = triangle;
+					}
+				}
+			}
+		}
+
+		// Nothing fits anymore, start the next meshlet from the first remaining triangle in the current order
+		if (bestTriangle == SIZE_MAX)
+		{
+			finishMeshlet();
+
+			while (isTriangleAdded[searchCursor]) ++searchCursor;
+			bestTriangle = searchCursor;
+		}
+
+		addTriangle(bestTriangle);
+	}
+	finishMeshlet();
+
+	mesh.vertices = std::move(vertices);
+	mesh.indices = std::move(indices);
+}
+
+MeshOptimizer::OptimizationResult MeshOptimizer::OptimizeMesh(Mesh& mesh)
+{
+	OptimizationResult result{};
+	result.acmrBefore = ComputeACMR(mesh.indices, mesh.vertices.size());
+
+	if (mesh.primitiveTopology == PrimitiveTopology::TriangleList)
+	{
+		OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+		OptimizeVertexFetch(mesh.vertices, mesh.indices);
+	}
+
+	result.acmrAfter = ComputeACMR(mesh.indices, mesh.vertices.size());
+	return result;
+}
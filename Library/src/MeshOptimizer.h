@@ -0,0 +1,43 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	namespace MeshOptimizer
+	{
+		// FIFO cache size the ACMR is reported for, close to what hardware vertex caches used to be
+		constexpr size_t ACMR_CACHE_SIZE{ 16 };
+
+		// Average cache miss ratio, the number of vertices transformed per triangle by a FIFO post-transform cache.
+		// 0.5 is the best a regular grid can get, 3 means no reuse at all.
+		float ComputeACMR(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize = ACMR_CACHE_SIZE);
+
+		// Reorders triangles for vertex reuse with Tom Forsyth's linear-speed vertex cache optimisation
+		void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+		// Renumbers vertices in order of first use so they are fetched front to back, unused vertices move to the end
+		void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+		constexpr size_t MESHLET_MAX_VERTICES{ 64 };
+		constexpr size_t MESHLET_MAX_TRIANGLES{ 64 };
+
+		// Splits a triangle list into spatially compact meshlets. Each one is seeded with the first remaining triangle,
+		// so the meshlets follow the current triangle order and it's best run after OptimizeVertexCache.
+		// Vertices shared between meshlets are duplicated, each meshlet gets its own range.
+		void BuildMeshlets(Mesh& mesh);
+
+		struct OptimizationResult
+		{
+			float acmrBefore{};
+			float acmrAfter{};
+		};
+
+		// Runs both passes on a triangle list mesh, strips are left untouched
+		OptimizationResult OptimizeMesh(Mesh& mesh);
+	}
+}
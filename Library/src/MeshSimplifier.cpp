@@ -0,0 +1,553 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <unordered_map>
+
+using namespace dae;
+
+namespace
+{
+	// Border edges get a plane through them, perpendicular to their triangle, weighted this much heavier
+	// than a triangle's own plane so open edges keep their outline
+	constexpr double BORDER_WEIGHT{ 10.0 };
+
+	// How far past the cost of the pass' goal collapse a pass may go
+	constexpr double PASS_COST_SLACK{ 1.5 };
+
+	// Collapses that turn a triangle's normal further than this cosine away from where it was are rejected
+	constexpr float MIN_NORMAL_DOT{ 0.25f };
+
+	// Symmetric 4x4 matrix of summed plane equations, Evaluate gives the weighted sum of squared plane distances
+	struct Quadric
+	{
+		double a00{}, a01{}, a02{}, a11{}, a12{}, a22{};
+		double b0{}, b1{}, b2{};
+		double c{};
+		double weight{};
+
+		void AddPlane(const Vector3& normal, float distance, double planeWeight)
+		{
+			const double nx{ normal.x };
+			const double ny{ normal.y };
+			const double nz{ normal.z };
+			const double d{ distance };
+
+			a00 += planeWeight * nx * nx;
+			a01 += planeWeight * nx * ny;
+			a02 += planeWeight * nx * nz;
+			a11 += planeWeight * ny * ny;
+			a12 += planeWeight * ny * nz;
+			a22 += planeWeight * nz * nz;
+			b0 += planeWeight * nx * d;
+			b1 += planeWeight * ny * d;
+			b2 += planeWeight * nz * d;
+			c += planeWeight * d * d;
+			weight += planeWeight;
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			a00 += other.a00; a01 += other.a01; a02 += other.a02;
+			a11 += other.a11; a12 += other.a12; a22 += other.a22;
+			b0 += other.b0; b1 += other.b1; b2 += other.b2;
+			c += other.c;
+			weight += other.weight;
+			return *this;
+		}
+
+		// Weighted mean of the squared distances, so errors of differently sized areas compare. Only orders collapses,
+		// merging quadrics averages it down, so it says little about how far the surface actually moved.
+		double Evaluate(const Vector3& p) const
+		{
+			if (weight <= 0.0) return 0.0;
+
+			const double x{ p.x };
+			const double y{ p.y };
+			const double z{ p.z };
+			const double result{
+				a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + a11 * y * y + 2.0 * a12 * y * z + a22 * z * z +
+				2.0 * (b0 * x + b1 * y + b2 * z) + c
+			};
+			return std::max(result, 0.0) / weight;
+		}
+	};
+
+	enum class PositionKind : uint8_t
+	{
+		Manifold,
+		Seam,
+		Locked
+	};
+
+	bool HaveSameAttributes(const Vertex& a, const Vertex& b)
+	{
+		return a.uv == b.uv && a.normal == b.normal && a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b;
+	}
+
+	struct Collapse
+	{
+		uint32_t from{};
+		uint32_t to{};
+		double cost{};
+	};
+
+	// Same key for both directions of an edge
+	uint64_t EdgeKey(uint32_t a, uint32_t b)
+	{
+		return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+	}
+
+	Vector3 TriangleNormal(const Vector3& p0, const Vector3& p1, const Vector3& p2)
+	{
+		return Vector3::Cross(p1 - p0, p2 - p0);
+	}
+
+	// Closest point on the triangle by the Voronoi region p falls in, see Ericson's Real-Time Collision Detection 5.1.5
+	float PointTriangleDistance(const Vector3& p, const Vector3& a, const Vector3& b, const Vector3& c)
+	{
+		const Vector3 ab{ b - a };
+		const Vector3 ac{ c - a };
+		const Vector3 ap{ p - a };
+		const float d1{ Vector3::Dot(ab, ap) };
+		const float d2{ Vector3::Dot(ac, ap) };
+		if (d1 <= 0.f && d2 <= 0.f) return ap.Magnitude();
+
+		const Vector3 bp{ p - b };
+		const float d3{ Vector3::Dot(ab, bp) };
+		const float d4{ Vector3::Dot(ac, bp) };
+		if (d3 >= 0.f && d4 <= d3) return bp.Magnitude();
+
+		const float vc{ d1 * d4 - d3 * d2 };
+		if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) return (p - (a + ab * (d1 / (d1 - d3)))).Magnitude();
+
+		const Vector3 cp{ p - c };
+		const float d5{ Vector3::Dot(ab, cp) };
+		const float d6{ Vector3::Dot(ac, cp) };
+		if (d6 >= 0.f && d5 <= d6) return cp.Magnitude();
+
+		const float vb{ d5 * d2 - d1 * d6 };
+		if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) return (p - (a + ac * (d2 / (d2 - d6)))).Magnitude();
+
+		const float va{ d3 * d6 - d5 * d4 };
+		if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f)
+		{
+			return (p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))))).Magnitude();
+		}
+
+		const float denominator{ 1.f / (va + vb + vc) };
+		return (p - (a + ab * (vb * denominator) + ac * (vc * denominator))).Magnitude();
+	}
+
+	struct PositionHash
+	{
+		size_t operator()(const Vector3& position) const
+		{
+			size_t hash{ std::hash<float>{}(position.x) };
+			hash ^= std::hash<float>{}(position.y) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			hash ^= std::hash<float>{}(position.z) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+			return hash;
+		}
+	};
+
+	// Exact, unlike Vector3's operator==, so it agrees with PositionHash
+	struct PositionEqual
+	{
+		bool operator()(const Vector3& a, const Vector3& b) const
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+	};
+}
+
+std::vector<uint32_t> MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, size_t targetIndexCount, float& error)
+{
+	error = 0.f;
+
+	// Collapses happen between positions, so seams that split vertices move together
+	std::vector<uint32_t> vertexPositions(vertices.size());
+	std::vector<Vector3> positions{};
+	std::vector<std::vector<uint32_t>> positionVertices{};
+	{
+		std::unordered_map<Vector3, uint32_t, PositionHash, PositionEqual> positionLookup{};
+		for (size_t i{ 0 }; i < vertices.size(); ++i)
+		{
+			const auto [it, isNew]{ positionLookup.try_emplace(vertices[i].position, static_cast<uint32_t>(positions.size())) };
+			if (isNew)
+			{
+				positions.push_back(vertices[i].position);
+				positionVertices.emplace_back();
+			}
+			vertexPositions[i] = it->second;
+			positionVertices[it->second].push_back(static_cast<uint32_t>(i));
+		}
+	}
+
+	// Positions where vertices with different attributes meet. With two attribute sets the position sits on a seam and
+	// may only slide along it, onto another seam position. Where more seams meet it stays where it is.
+	std::vector<PositionKind> positionKinds(positions.size(), PositionKind::Manifold);
+	for (size_t position{ 0 }; position < positions.size(); ++position)
+	{
+		std::vector<uint32_t> attributeSets{};
+		for (const uint32_t vertex : positionVertices[position])
+		{
+			const bool isKnown{ std::any_of(attributeSets.begin(), attributeSets.end(), [&](uint32_t other) { return HaveSameAttributes(vertices[vertex], vertices[other]); }) };
+			if (!isKnown) attributeSets.push_back(vertex);
+		}
+
+		if (attributeSets.size() == 2) positionKinds[position] = PositionKind::Seam;
+		else if (attributeSets.size() > 2) positionKinds[position] = PositionKind::Locked;
+	}
+
+	const size_t triangleCount{ indices.size() / 3 };
+	std::vector<std::array<uint32_t, 3>> triangles(triangleCount);
+	std::vector<bool> isTriangleAlive(triangleCount, true);
+	std::vector<std::vector<uint32_t>> positionTriangles(positions.size());
+	size_t aliveCount{ 0 };
+
+	for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+	{
+		for (int corner{ 0 }; corner < 3; ++corner)
+		{
+			triangles[triangle][corner] = vertexPositions[indices[triangle * 3 + corner]];
+		}
+
+		const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+		if (ids[0] == ids[1] || ids[1] == ids[2] || ids[0] == ids[2])
+		{
+			isTriangleAlive[triangle] = false;
+			continue;
+		}
+
+		++aliveCount;
+		for (const uint32_t id : ids)
+		{
+			positionTriangles[id].push_back(static_cast<uint32_t>(triangle));
+		}
+	}
+
+	// Every position starts with the planes of its triangles, area weighted
+	std::vector<Quadric> quadrics(positions.size());
+	{
+		std::unordered_map<uint64_t, uint32_t> edgeUses{};
+
+		for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+		{
+			if (!isTriangleAlive[triangle]) continue;
+
+			const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+			for (int corner{ 0 }; corner < 3; ++corner)
+			{
+				++edgeUses[EdgeKey(ids[corner], ids[(corner + 1) % 3])];
+			}
+		}
+
+		for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+		{
+			if (!isTriangleAlive[triangle]) continue;
+
+			const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+			const Vector3 normal{ TriangleNormal(positions[ids[0]], positions[ids[1]], positions[ids[2]]) };
+			const float doubleArea{ normal.Magnitude() };
+			if (doubleArea <= 0.f) continue;
+
+			const Vector3 unitNormal{ normal / doubleArea };
+			for (const uint32_t id : ids)
+			{
+				quadrics[id].AddPlane(unitNormal, -Vector3::Dot(unitNormal, positions[ids[0]]), doubleArea * 0.5);
+			}
+
+			for (int corner{ 0 }; corner < 3; ++corner)
+			{
+				const uint32_t a{ ids[corner] };
+				const uint32_t b{ ids[(corner + 1) % 3] };
+				if (edgeUses[EdgeKey(a, b)] != 1) continue;
+
+				const Vector3 edge{ positions[b] - positions[a] };
+				const Vector3 borderNormal{ Vector3::Cross(edge, unitNormal) };
+				if (borderNormal.SqrMagnitude() <= 0.f) continue;
+
+				const Vector3 unitBorderNormal{ borderNormal.Normalized() };
+				const double borderWeight{ BORDER_WEIGHT * edge.SqrMagnitude() };
+				quadrics[a].AddPlane(unitBorderNormal, -Vector3::Dot(unitBorderNormal, positions[a]), borderWeight);
+				quadrics[b].AddPlane(unitBorderNormal, -Vector3::Dot(unitBorderNormal, positions[a]), borderWeight);
+			}
+		}
+	}
+
+	// Original connectivity, the error is measured from it once the simplified one is known
+	const std::vector<std::array<uint32_t, 3>> originalTriangles{ triangles };
+	const std::vector<std::vector<uint32_t>> originalPositionTriangles{ positionTriangles };
+
+	const size_t targetTriangleCount{ targetIndexCount / 3 };
+	std::vector<uint64_t> edges{};
+
+	// Position every position was collapsed onto, itself while it is still around
+	std::vector<uint32_t> collapsedInto(positions.size());
+	for (size_t position{ 0 }; position < positions.size(); ++position)
+	{
+		collapsedInto[position] = static_cast<uint32_t>(position);
+	}
+
+	std::vector<Collapse> collapses{};
+	std::vector<bool> isLocked(positions.size(), false);
+
+	// The edge between a and b runs along a seam when its two triangles use different vertices at both ends.
+	// Any other edge leaving a seam position would drag one side of the seam across the other.
+	const auto isSeamEdge{ [&](uint32_t a, uint32_t b)
+		{
+			std::array<uint32_t, 2> verticesA{};
+			std::array<uint32_t, 2> verticesB{};
+			size_t sharedCount{ 0 };
+			for (const uint32_t triangle : positionTriangles[a])
+			{
+				if (!isTriangleAlive[triangle]) continue;
+
+				const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+				if (ids[0] != b && ids[1] != b && ids[2] != b) continue;
+				if (sharedCount == 2) return false;
+
+				for (int corner{ 0 }; corner < 3; ++corner)
+				{
+					if (ids[corner] == a) verticesA[sharedCount] = indices[triangle * 3 + corner];
+					if (ids[corner] == b) verticesB[sharedCount] = indices[triangle * 3 + corner];
+				}
+				++sharedCount;
+			}
+
+			return sharedCount == 2 &&
+				!HaveSameAttributes(vertices[verticesA[0]], vertices[verticesA[1]]) &&
+				!HaveSameAttributes(vertices[verticesB[0]], vertices[verticesB[1]]);
+		} };
+
+	// Moving from onto to must not tear a seam, seam positions only slide along theirs
+	const auto canMove{ [&](uint32_t from, uint32_t to)
+		{
+			switch (positionKinds[from])
+			{
+			case PositionKind::Manifold:
+				return true;
+			case PositionKind::Seam:
+				return positionKinds[to] != PositionKind::Manifold && isSeamEdge(from, to);
+			default:
+				return false;
+			}
+		} };
+
+	// Nor may it flip or fold any triangle around from
+	const auto isCollapseValid{ [&](uint32_t from, uint32_t to)
+		{
+			for (const uint32_t triangle : positionTriangles[from])
+			{
+				if (!isTriangleAlive[triangle]) continue;
+
+				const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+				if (ids[0] == to || ids[1] == to || ids[2] == to) continue;
+
+				std::array<Vector3, 3> corners{ positions[ids[0]], positions[ids[1]], positions[ids[2]] };
+				const Vector3 before{ TriangleNormal(corners[0], corners[1], corners[2]) };
+				for (int corner{ 0 }; corner < 3; ++corner)
+				{
+					if (ids[corner] == from) corners[corner] = positions[to];
+				}
+				const Vector3 after{ TriangleNormal(corners[0], corners[1], corners[2]) };
+
+				if (Vector3::Dot(before, after) < MIN_NORMAL_DOT * before.Magnitude() * after.Magnitude()) return false;
+			}
+			return true;
+		} };
+
+	while (aliveCount > targetTriangleCount)
+	{
+		edges.clear();
+		for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+		{
+			if (!isTriangleAlive[triangle]) continue;
+
+			const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+			for (int corner{ 0 }; corner < 3; ++corner)
+			{
+				edges.push_back(EdgeKey(ids[corner], ids[(corner + 1) % 3]));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+		// Cheapest direction of every edge still around
+		collapses.clear();
+		for (const uint64_t edge : edges)
+		{
+			const uint32_t a{ static_cast<uint32_t>(edge >> 32) };
+			const uint32_t b{ static_cast<uint32_t>(edge) };
+
+			Quadric combined{ quadrics[a] };
+			combined += quadrics[b];
+
+			const bool canMoveA{ canMove(a, b) };
+			const bool canMoveB{ canMove(b, a) };
+			if (!canMoveA && !canMoveB) continue;
+
+			const double costToB{ canMoveA ? combined.Evaluate(positions[b]) : DBL_MAX };
+			const double costToA{ canMoveB ? combined.Evaluate(positions[a]) : DBL_MAX };
+			collapses.push_back(costToB <= costToA ? Collapse{ a, b, costToB } : Collapse{ b, a, costToA });
+		}
+
+		if (collapses.empty()) break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) { return lhs.cost < rhs.cost; });
+		std::fill(isLocked.begin(), isLocked.end(), false);
+
+		// An interior collapse removes two triangles. Locking skips plenty of the cheap ones, so rather than walking
+		// far into expensive collapses the pass stops a bit past what reaching the target would have cost.
+		const size_t collapseGoal{ std::min((aliveCount - targetTriangleCount) / 2 + 1, collapses.size()) };
+		const double passCostLimit{ collapses[collapseGoal - 1].cost * PASS_COST_SLACK };
+
+		// Collapses in one pass don't share any triangles, so each one's checks stay valid until it is applied
+		size_t collapseCount{ 0 };
+		for (const Collapse& collapse : collapses)
+		{
+			if (aliveCount <= targetTriangleCount) break;
+			if (collapse.cost > passCostLimit && collapseCount > 0) break;
+			if (isLocked[collapse.from] || isLocked[collapse.to]) continue;
+			if (!isCollapseValid(collapse.from, collapse.to)) continue;
+
+			for (const uint32_t triangle : positionTriangles[collapse.from])
+			{
+				if (!isTriangleAlive[triangle]) continue;
+
+				for (const uint32_t id : triangles[triangle])
+				{
+					isLocked[id] = true;
+				}
+			}
+
+			for (const uint32_t triangle : positionTriangles[collapse.from])
+			{
+				if (!isTriangleAlive[triangle]) continue;
+
+				std::array<uint32_t, 3>& ids{ triangles[triangle] };
+				for (uint32_t& id : ids)
+				{
+					if (id == collapse.from) id = collapse.to;
+				}
+
+				if (ids[0] == ids[1] || ids[1] == ids[2] || ids[0] == ids[2])
+				{
+					isTriangleAlive[triangle] = false;
+					--aliveCount;
+				}
+				else
+				{
+					positionTriangles[collapse.to].push_back(triangle);
+				}
+			}
+			positionTriangles[collapse.from].clear();
+
+			quadrics[collapse.to] += quadrics[collapse.from];
+			collapsedInto[collapse.from] = collapse.to;
+			++collapseCount;
+		}
+
+		if (collapseCount == 0) break;
+	}
+
+	const auto survivorOf{ [&](uint32_t position)
+		{
+			while (collapsedInto[position] != position) position = collapsedInto[position];
+			return position;
+		} };
+
+	// Remaining positions are original ones, so they lie on the original surface. The other way around, every original
+	// position is measured against the simplified triangles around where it and its original neighbours ended up.
+	// Closer parts of the simplified surface further away are ignored, so the error can only come out too large.
+	std::vector<uint32_t> survivors{};
+	for (size_t position{ 0 }; position < positions.size(); ++position)
+	{
+		survivors.clear();
+		for (const uint32_t triangle : originalPositionTriangles[position])
+		{
+			for (const uint32_t id : originalTriangles[triangle])
+			{
+				survivors.push_back(survivorOf(id));
+			}
+		}
+		if (survivors.empty()) continue;
+
+		std::sort(survivors.begin(), survivors.end());
+		survivors.erase(std::unique(survivors.begin(), survivors.end()), survivors.end());
+
+		float distance{ FLT_MAX };
+		for (const uint32_t survivor : survivors)
+		{
+			for (const uint32_t triangle : positionTriangles[survivor])
+			{
+				if (!isTriangleAlive[triangle]) continue;
+
+				const std::array<uint32_t, 3>& ids{ triangles[triangle] };
+				distance = std::min(distance, PointTriangleDistance(positions[position], positions[ids[0]], positions[ids[1]], positions[ids[2]]));
+			}
+		}
+
+		// The whole neighbourhood collapsed away, as small disconnected parts do, so the part shrank to where it went
+		if (distance == FLT_MAX) distance = (positions[position] - positions[survivorOf(static_cast<uint32_t>(position))]).Magnitude();
+		error = std::max(error, distance);
+	}
+
+	// Corners that moved to another position take the vertex there whose attributes are closest to their own
+	const auto closestVertex{ [&](uint32_t vertex, uint32_t position)
+		{
+			if (vertexPositions[vertex] == position) return vertex;
+
+			const Vertex& source{ vertices[vertex] };
+			uint32_t best{ positionVertices[position][0] };
+			float bestDistance{ FLT_MAX };
+			for (const uint32_t candidate : positionVertices[position])
+			{
+				const Vertex& target{ vertices[candidate] };
+				const float distance{ (target.uv - source.uv).SqrMagnitude() + (target.normal - source.normal).SqrMagnitude() };
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = candidate;
+				}
+			}
+			return best;
+		} };
+
+	std::vector<uint32_t> result{};
+	result.reserve(aliveCount * 3);
+	for (size_t triangle{ 0 }; triangle < triangleCount; ++triangle)
+	{
+		if (!isTriangleAlive[triangle]) continue;
+
+		for (int corner{ 0 }; corner < 3; ++corner)
+		{
+			result.push_back(closestVertex(indices[triangle * 3 + corner], triangles[triangle][corner]));
+		}
+	}
+
+	return result;
+}
+
+void MeshSimplifier::BuildLods(Mesh& mesh)
+{
+	mesh.lods.clear();
+	if (mesh.primitiveTopology != PrimitiveTopology::TriangleList) return;
+
+	size_t previousIndexCount{ mesh.indices.size() };
+	for (size_t level{ 0 }; level < MAX_LOD_COUNT; ++level)
+	{
+		const size_t targetIndexCount{ static_cast<size_t>(static_cast<float>(previousIndexCount) * LOD_REDUCTION) / 3 * 3 };
+
+		MeshLod lod{};
+		lod.indices = Simplify(mesh.vertices, mesh.indices, targetIndexCount, lod.error);
+
+		// Borders and flip checks eventually stop the simplifier from getting much further
+		if (static_cast<float>(lod.indices.size()) > static_cast<float>(previousIndexCount) * 0.9f) break;
+
+		previousIndexCount = lod.indices.size();
+		mesh.lods.push_back(std::move(lod));
+	}
+}
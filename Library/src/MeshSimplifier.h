@@ -0,0 +1,31 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	namespace MeshSimplifier
+	{
+		// Each LOD aims for this fraction of the previous one's triangles
+		constexpr float LOD_REDUCTION{ 0.5f };
+		constexpr size_t MAX_LOD_COUNT{ 5 };
+
+		// Collapses edges by quadric error until at most targetIndexCount indices are left, or nothing can collapse
+		// without flipping a triangle. Vertices sharing a position are collapsed together, the result indexes the
+		// same vertices. error receives the largest distance of an original vertex from the simplified surface, in the
+		// vertices' units. Only the simplified triangles near the vertex are searched, so it errs on the large side.
+		std::vector<uint32_t> Simplify(
+			const std::vector<Vertex>& vertices,
+			const std::vector<uint32_t>& indices,
+			size_t targetIndexCount,
+			float& error
+		);
+
+		// Fills mesh.lods, stops early once the simplifier stops making progress. Triangle lists only.
+		void BuildLods(Mesh& mesh);
+	}
+}
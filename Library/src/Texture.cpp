@@ -1,54 +1,251 @@
 #include "Texture.h"
-#include "Vector2.h"
+#include "MathHelpers.h"
 #include <SDL_image.h>
-#include <iostream>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <emmintrin.h>
 
 namespace dae
 {
-	Texture::Texture(SDL_Surface* pSurface) :
-		m_pSurface{ pSurface },
-		m_pSurfacePixels{ (uint32_t*)pSurface->pixels }
+	namespace
 	{
-	}
+		// Box filters each 2x2 block of the source level into one texel of the destination level.
+		// Odd sizes repeat the last row or column of the source.
+		template<typename Texel, typename Average>
+		void DownsampleLevel(std::vector<Texel>& texels, size_t sourceOffset, int sourceWidth, int sourceHeight,
+			size_t destinationOffset, int destinationWidth, int destinationHeight, Average average)
+		{
+			for (int y{ 0 }; y < destinationHeight; ++y)
+			{
+				const int y0{ std::min(y * 2, sourceHeight - 1) };
+				const int y1{ std::min(y * 2 + 1, sourceHeight - 1) };
+				const Texel* pRow0{ texels.data() + sourceOffset + static_cast<size_t>(y0) * sourceWidth };
+				const Texel* pRow1{ texels.data() + sourceOffset + static_cast<size_t>(y1) * sourceWidth };
+				Texel* pDestination{ texels.data() + destinationOffset + static_cast<size_t>(y) * destinationWidth };
 
-	Texture::~Texture()
-	{
-		if (m_pSurface)
+				for (int x{ 0 }; x < destinationWidth; ++x)
+				{
+					const int x0{ std::min(x * 2, sourceWidth - 1) };
+					const int x1{ std::min(x * 2 + 1, sourceWidth - 1) };
+					pDestination[x] = average(pRow0[x0], pRow0[x1], pRow1[x0], pRow1[x1]);
+				}
+			}
+		}
+
+		uint32_t AverageRGBA8(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+		{
+			uint32_t result{};
+			for (uint32_t shift{ 0 }; shift < 32; shift += 8)
+			{
+				const uint32_t sum{ (a >> shift & 0xFF) + (b >> shift & 0xFF) + (c >> shift & 0xFF) + (d >> shift & 0xFF) };
+				result |= (sum + 2) / 4 << shift;
+			}
+			return result;
+		}
+
+		ColorRGB AverageRGBFloat(const ColorRGB& a, const ColorRGB& b, const ColorRGB& c, const ColorRGB& d)
+		{
+			return (a + b + c + d) * .25f;
+		}
+
+		// The exponent of the float plus a quadratic fit of log2 over its mantissa, within .005 of std::log2 at a fraction
+		// of the cost. Zero comes out as -127, infinity and NaN as 128.
+		float ApproximateLog2(float value)
+		{
+			const uint32_t bits{ std::bit_cast<uint32_t>(value) };
+			const float exponent{ static_cast<float>(static_cast<int>(bits >> 23 & 0xFF) - 128) };
+			const float mantissa{ std::bit_cast<float>((bits & 0x7FFFFF) | 0x3F800000) };
+			return exponent + (-.34484843f * mantissa + 2.02466578f) * mantissa - .67487759f;
+		}
+
+		// Texel coordinate of a wrapped texture coordinate, relative to texel corners
+		float WrapToTexels(float coordinate, int size)
+		{
+			return (coordinate - std::floor(coordinate)) * static_cast<float>(size);
+		}
+
+		// Filtering works on r, g, b, a lanes, RGBA8 texels stay in [0, 255] until the sample is scaled once at the end
+		__m128 LoadTexel(const uint32_t* pTexels, size_t index)
 		{
-			SDL_FreeSurface(m_pSurface);
-			m_pSurface = nullptr;
+			const __m128i zero{ _mm_setzero_si128() };
+			const __m128i bytes{ _mm_cvtsi32_si128(static_cast<int>(pTexels[index])) };
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero));
+		}
+
+		__m128 LoadTexel(const ColorRGB* pTexels, size_t index)
+		{
+			const ColorRGB& texel{ pTexels[index] };
+			return _mm_setr_ps(texel.r, texel.g, texel.b, 0.f);
+		}
+
+		__m128 Lerp(__m128 a, __m128 b, float factor)
+		{
+			return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(factor)));
+		}
+
+		template<typename Texel>
+		__m128 SampleNearest(const Texel* pLevel, int width, int height, const Vector2& uv)
+		{
+			// The clamps catch coordinates rounding up to the size, and NaN ones
+			const int x{ Clamp(static_cast<int>(WrapToTexels(uv.x, width)), 0, width - 1) };
+			const int y{ Clamp(static_cast<int>(WrapToTexels(uv.y, height)), 0, height - 1) };
+
+			return LoadTexel(pLevel, static_cast<size_t>(y) * width + x);
+		}
+
+		template<typename Texel>
+		__m128 SampleBilinear(const Texel* pLevel, int width, int height, const Vector2& uv)
+		{
+			// Relative to texel centers, so the four texels around it are x0, x0 + 1 and y0, y0 + 1
+			const float texelX{ WrapToTexels(uv.x, width) - .5f };
+			const float texelY{ WrapToTexels(uv.y, height) - .5f };
+			const float floorX{ std::floor(texelX) };
+			const float floorY{ std::floor(texelY) };
+
+			// Neighbours across the border wrap to the opposite edge
+			const int x0{ Clamp(static_cast<int>(floorX), -1, width - 1) };
+			const int y0{ Clamp(static_cast<int>(floorY), -1, height - 1) };
+			const size_t column0{ static_cast<size_t>(x0 < 0 ? width - 1 : x0) };
+			const size_t column1{ static_cast<size_t>(x0 + 1 < width ? x0 + 1 : 0) };
+			const size_t row0{ static_cast<size_t>(y0 < 0 ? height - 1 : y0) * width };
+			const size_t row1{ static_cast<size_t>(y0 + 1 < height ? y0 + 1 : 0) * width };
+
+			const float blendX{ texelX - floorX };
+			const __m128 top{ Lerp(LoadTexel(pLevel, row0 + column0), LoadTexel(pLevel, row0 + column1), blendX) };
+			const __m128 bottom{ Lerp(LoadTexel(pLevel, row1 + column0), LoadTexel(pLevel, row1 + column1), blendX) };
+			return Lerp(top, bottom, texelY - floorY);
 		}
 	}
 
-	Texture* Texture::LoadFromFile(const std::string& path)
+	Texture::Texture(int width, int height, TextureFormat format) :
+		m_Width{ width },
+		m_Height{ height },
+		m_Format{ format }
 	{
-		SDL_Surface* surface{ IMG_Load(path.c_str()) };
-		if (surface == nullptr)
+	}
+
+	Texture* Texture::LoadFromFile(const std::string& path, TextureFormat format)
+	{
+		SDL_Surface* pLoadedSurface{ IMG_Load(path.c_str()) };
+		if (pLoadedSurface == nullptr)
+		{
+			throw TextureLoadFailedException();
+		}
+
+		// Whatever the file stored, SDL converts it to bytes in R, G, B, A order, which is the RGBA8 layout
+		SDL_Surface* pSurface{ SDL_ConvertSurfaceFormat(pLoadedSurface, SDL_PIXELFORMAT_RGBA32, 0) };
+		SDL_FreeSurface(pLoadedSurface);
+		if (pSurface == nullptr)
 		{
 			throw TextureLoadFailedException();
 		}
-		
-		return new Texture(surface);
+
+		Texture* pTexture{ new Texture(pSurface->w, pSurface->h, format) };
+
+		size_t texelCount{ 0 };
+		for (int width{ pSurface->w }, height{ pSurface->h };; width = std::max(width / 2, 1), height = std::max(height / 2, 1))
+		{
+			pTexture->m_MipLevels.push_back(MipLevel{ width, height, texelCount });
+			texelCount += static_cast<size_t>(width) * height;
+			if (width == 1 && height == 1) break;
+		}
+
+		std::vector<uint32_t> texels(texelCount);
+		const size_t width{ static_cast<size_t>(pSurface->w) };
+		const size_t height{ static_cast<size_t>(pSurface->h) };
+		const uint8_t* pRows{ static_cast<const uint8_t*>(pSurface->pixels) };
+		for (size_t y{ 0 }; y < height; ++y)
+		{
+			std::memcpy(texels.data() + y * width, pRows + y * pSurface->pitch, width * sizeof(uint32_t));
+		}
+		SDL_FreeSurface(pSurface);
+
+		const auto buildMipChain{ [&](auto& levelTexels, auto average)
+			{
+				const std::vector<MipLevel>& levels{ pTexture->m_MipLevels };
+				for (size_t i{ 1 }; i < levels.size(); ++i)
+				{
+					DownsampleLevel(levelTexels, levels[i - 1].offset, levels[i - 1].width, levels[i - 1].height,
+						levels[i].offset, levels[i].width, levels[i].height, average);
+				}
+			} };
+
+		if (format == TextureFormat::RGBFloat)
+		{
+			// Converted before downsampling, so the smaller levels aren't quantized either
+			std::vector<ColorRGB>& floatTexels{ pTexture->m_FloatTexels };
+			floatTexels.resize(texelCount);
+			for (size_t i{ 0 }; i < width * height; ++i)
+			{
+				floatTexels[i] = ColorRGB{
+					static_cast<float>(texels[i] & 0xFF) / 255.f,
+					static_cast<float>(texels[i] >> 8 & 0xFF) / 255.f,
+					static_cast<float>(texels[i] >> 16 & 0xFF) / 255.f
+				};
+			}
+			buildMipChain(floatTexels, AverageRGBFloat);
+		}
+		else
+		{
+			buildMipChain(texels, AverageRGBA8);
+			pTexture->m_Texels = std::move(texels);
+		}
+
+		return pTexture;
+	}
+
+	ColorRGB Texture::Sample(const TextureCoordinate& coordinate, TextureFilter filter) const
+	{
+		if (m_Format == TextureFormat::RGBFloat) return Sample(m_FloatTexels, coordinate, filter, 1.f);
+		return Sample(m_Texels, coordinate, filter, 1.f / 255.f);
+	}
+
+	float Texture::GetLevelOfDetail(const TextureCoordinate& coordinate) const
+	{
+		// The footprint is the longer of the pixel's two edges, measured in texels of the full resolution level
+		const float width{ static_cast<float>(m_Width) };
+		const float height{ static_cast<float>(m_Height) };
+		const float lengthSquaredX{ Square(coordinate.dx.x * width) + Square(coordinate.dx.y * height) };
+		const float lengthSquaredY{ Square(coordinate.dy.x * width) + Square(coordinate.dy.y * height) };
+		const float levelOfDetail{ .5f * ApproximateLog2(std::max(lengthSquaredX, lengthSquaredY)) };
+
+		// Degenerate derivatives end up on the coarsest level
+		const float lastLevel{ static_cast<float>(m_MipLevels.size() - 1) };
+		return Clamp(levelOfDetail, 0.f, lastLevel);
 	}
 
-	ColorRGB Texture::Sample(const Vector2& uv) const
+	template<typename Texel>
+	ColorRGB Texture::Sample(const std::vector<Texel>& texels, const TextureCoordinate& coordinate, TextureFilter filter, float scale) const
 	{
-		if (uv.x <= 0) return {};
-		const int pixelX{ static_cast<int>(static_cast<float>(m_pSurface->w) * uv.x) };
-		const int pixelY{ static_cast<int>(static_cast<float>(m_pSurface->h) * uv.y)};
-
-		const int pixelIndex{ m_pSurface->w * pixelY + pixelX };
-		const uint32_t pixel{ m_pSurfacePixels[pixelIndex] };
-		
-		uint8_t r{};
-		uint8_t g{};
-		uint8_t b{};
-		SDL_GetRGB(pixel, m_pSurface->format, &r, &g, &b);
-
-		return { ColorRGB{
-			static_cast<float>(r) / 255.f,
-			static_cast<float>(g) / 255.f,
-			static_cast<float>(b) / 255.f
-		} };
+		const auto sampleLevel{ [&](size_t levelIndex, bool isBilinear)
+			{
+				const MipLevel& level{ m_MipLevels[levelIndex] };
+				const Texel* pLevel{ texels.data() + level.offset };
+				if (isBilinear) return SampleBilinear(pLevel, level.width, level.height, coordinate.uv);
+				return SampleNearest(pLevel, level.width, level.height, coordinate.uv);
+			} };
+
+		__m128 sample{};
+		if (filter == TextureFilter::point)
+		{
+			sample = sampleLevel(0, false);
+		}
+		else
+		{
+			const float levelOfDetail{ GetLevelOfDetail(coordinate) };
+			const size_t nearestLevel{ static_cast<size_t>(levelOfDetail + .5f) };
+			const size_t finerLevel{ static_cast<size_t>(levelOfDetail) };
+			const float blend{ levelOfDetail - static_cast<float>(finerLevel) };
+
+			if (filter == TextureFilter::nearestMip) sample = sampleLevel(nearestLevel, false);
+			else if (filter == TextureFilter::bilinear || blend == 0.f) sample = sampleLevel(nearestLevel, true);
+			else sample = Lerp(sampleLevel(finerLevel, true), sampleLevel(finerLevel + 1, true), blend);
+		}
+
+		alignas(16) float channels[4];
+		_mm_store_ps(channels, _mm_mul_ps(sample, _mm_set1_ps(scale)));
+		return ColorRGB{ channels[0], channels[1], channels[2] };
 	}
-}
\ No newline at end of file
+}
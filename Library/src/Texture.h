@@ -1,27 +1,84 @@
 #pragma once
-#include <SDL_surface.h>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "ColorRGB.h"
+#include "Vector2.h"
 
 namespace dae
 {
 	class TextureLoadFailedException{};
 
-	struct Vector2;
+	// Layout the texels are kept in after decoding
+	enum class TextureFormat
+	{
+		// 8 bits per channel, red in the lowest byte
+		RGBA8,
+		// RGBA8 texels converted to float RGB at load, only the averaged mip levels carry more precision than RGBA8.
+		// Three times the memory, but nothing to convert when sampling
+		RGBFloat
+	};
+
+	enum class TextureFilter
+	{
+		// Closest texel of the full resolution image, the mip chain is ignored
+		point,
+		// Closest texel of the closest mip level
+		nearestMip,
+		// Four closest texels of the closest mip level
+		bilinear,
+		// Bilinear in the two closest mip levels, blended by the fractional level
+		trilinear
+	};
+
+	// Where a pixel samples, with the change of uv to the next pixel right (dx) and down (dy), which picks the mip level
+	struct TextureCoordinate
+	{
+		Vector2 uv{};
+		Vector2 dx{};
+		Vector2 dy{};
+	};
 
+	// Loaded with a full mip chain, every level half the size of the one before down to 1x1.
+	// Coordinates outside [0, 1] wrap around.
 	class Texture
 	{
 	public:
-		~Texture();
-
-		static Texture* LoadFromFile(const std::string& path);
-		ColorRGB Sample(const Vector2& uv) const;
+		static Texture* LoadFromFile(const std::string& path, TextureFormat format = TextureFormat::RGBA8);
+		ColorRGB Sample(const TextureCoordinate& coordinate, TextureFilter filter) const;
 		float SampleRed(const Vector2& uv) const;
 
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		TextureFormat GetFormat() const { return m_Format; }
+		size_t GetMipLevelCount() const { return m_MipLevels.size(); }
+
 	private:
-		Texture(SDL_Surface* pSurface);
+		struct MipLevel
+		{
+			int width{};
+			int height{};
+
+			// Of the level's first texel in the texel array
+			size_t offset{};
+		};
+
+		Texture(int width, int height, TextureFormat format);
+
+		int m_Width{};
+		int m_Height{};
+		TextureFormat m_Format{};
+
+		std::vector<MipLevel> m_MipLevels{};
+
+		// All mip levels back to back, only the one matching m_Format is filled
+		std::vector<uint32_t> m_Texels{};
+		std::vector<ColorRGB> m_FloatTexels{};
+
+		// Mip level the coordinate's footprint maps to, 0 being full resolution
+		float GetLevelOfDetail(const TextureCoordinate& coordinate) const;
 
-		SDL_Surface* m_pSurface{ nullptr };
-		uint32_t* m_pSurfacePixels{ nullptr };
+		template<typename Texel>
+		ColorRGB Sample(const std::vector<Texel>& texels, const TextureCoordinate& coordinate, TextureFilter filter, float scale) const;
 	};
-}
\ No newline at end of file
+}
@@ -1,6 +1,11 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <fstream>
+#include <span>
+#include <unordered_map>
 #include "Maths.h"
 #include "DataTypes.h"
 
@@ -10,71 +15,225 @@ namespace dae
 {
 	namespace GeometryUtils
 	{
-		struct TriResult
+		// Screen positions are snapped to 1/SUBPIXEL_SCALE of a pixel before rasterization
+		constexpr int SUBPIXEL_BITS{ 8 };
+		constexpr int SUBPIXEL_SCALE{ 1 << SUBPIXEL_BITS };
+
+		inline Vector2i SnapToSubpixel(const Vector4& screenPos)
+		{
+			return {
+				static_cast<int>(std::lround(screenPos.x * SUBPIXEL_SCALE)),
+				static_cast<int>(std::lround(screenPos.y * SUBPIXEL_SCALE))
+			};
+		}
+
+		// Rounds towards negative infinity, unlike integer division
+		inline int64_t FloorDiv(int64_t value, int64_t divisor)
+		{
+			const int64_t quotient{ value / divisor };
+			return (value % divisor != 0 && (value < 0) != (divisor < 0)) ? quotient - 1 : quotient;
+		}
+
+		// E(px, py) = a * px + b * py + c over whole pixel coordinates, evaluated at the pixel centre.
+		// Both the centre offset and the fill rule are folded into c, so a pixel is covered exactly when E >= 0.
+		struct EdgeFunction
+		{
+			int64_t a{};
+			int64_t b{};
+			int64_t c{};
+
+			int64_t Evaluate(int px, int py) const
+			{
+				return a * px + b * py + c;
+			}
+		};
+
+		struct TriangleEdges
+		{
+			bool valid{ false };
+
+			// Edge i lies opposite vertex i, so its normalized value is that vertex's barycentric weight
+			EdgeFunction e0{};
+			EdgeFunction e1{};
+			EdgeFunction e2{};
+			float invArea{};
+		};
+
+		// Edge from > to with the inside on the positive side, in subpixel units
+		inline EdgeFunction SetupEdgeFunction(const Vector2i& from, const Vector2i& to, bool flip)
+		{
+			int64_t a{ to.y - from.y };
+			int64_t b{ from.x - to.x };
+			if (flip)
+			{
+				a = -a;
+				b = -b;
+			}
+
+			// Top-left rule: a pixel centre exactly on an edge only belongs to the triangle if that edge is a top or left edge,
+			// which keeps pixels on shared edges from being drawn twice
+			const bool isTopLeft{ a > 0 || (a == 0 && b > 0) };
+			const int64_t bias{ isTopLeft ? 0 : -1 };
+
+			// E(P) = a * (P.x - from.x) + b * (P.y - from.y) with P = pixel * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2.
+			// Its sign matches that of a * px + b * py + floor(offset / SUBPIXEL_SCALE), which steps by a and b per pixel.
+			constexpr int64_t halfPixel{ SUBPIXEL_SCALE / 2 };
+			const int64_t offset{ a * (halfPixel - from.x) + b * (halfPixel - from.y) + bias };
+
+			return { a, b, FloorDiv(offset, SUBPIXEL_SCALE) };
+		}
+
+		// Twice the signed triangle area in subpixel units, exact for snapped positions.
+		// Positive for triangles that run counter-clockwise on screen (y pointing down).
+		inline int64_t SignedDoubleArea(const Vector2i& v0, const Vector2i& v1, const Vector2i& v2)
 		{
-			bool hit{ false };
-			float w0{ 1 }, w1{ 1 }, w2{ 1 };
+			return
+				static_cast<int64_t>(v2.y - v1.y) * (v0.x - v1.x) +
+				static_cast<int64_t>(v1.x - v2.x) * (v0.y - v1.y);
+		}
+
+		inline TriangleEdges SetupTriangleEdges(const Vector2i& v0, const Vector2i& v1, const Vector2i& v2)
+		{
+			const int64_t doubleArea{ SignedDoubleArea(v0, v1, v2) };
+			if (doubleArea == 0) return {};
+
+			// Accept both windings by flipping the edges so the inside is always positive
+			const bool flip{ doubleArea < 0 };
+
+			return {
+				true,
+				SetupEdgeFunction(v1, v2, flip),
+				SetupEdgeFunction(v2, v0, flip),
+				SetupEdgeFunction(v0, v1, flip),
+				static_cast<float>(SUBPIXEL_SCALE) / static_cast<float>(flip ? -doubleArea : doubleArea)
+			};
+		}
+
+		// v(x, y) = c + dx * x + dy * y over whole pixel coordinates, relative to some origin pixel
+		struct InterpolationPlane
+		{
+			float dx{};
+			float dy{};
+			float c{};
+
+			float Evaluate(float x, float y) const
+			{
+				return c + dx * x + dy * y;
+			}
 		};
 
-		TriResult HitTest_ScreenTriangle(Vector2 screenPos, const Vertex_Out& v0,  const Vertex_Out& v1, const Vertex_Out& v2)
+		// Screen space barycentric weights as planes, any value linear in screen space is a weighted sum of them
+		struct BarycentricPlanes
 		{
-			const float triArea{ std::abs(Vector2::Cross(v1.position - v0.position, v2.position - v0.position)) };
+			InterpolationPlane w0{};
+			InterpolationPlane w1{};
+			InterpolationPlane w2{};
 
-			const float w0{ std::abs(Vector2::Cross(screenPos - v1.position.ToVector2(), (v2.position - v1.position).ToVector2())) };
-			const float w1{ std::abs(Vector2::Cross(screenPos - v2.position.ToVector2(), (v0.position - v2.position).ToVector2())) };
-			const float w2{ std::abs(Vector2::Cross(screenPos - v0.position.ToVector2(), (v1.position - v0.position).ToVector2())) };
+			InterpolationPlane Interpolate(float v0, float v1, float v2) const
+			{
+				return {
+					v0 * w0.dx + v1 * w1.dx + v2 * w2.dx,
+					v0 * w0.dy + v1 * w1.dy + v2 * w2.dy,
+					v0 * w0.c + v1 * w1.c + v2 * w2.c
+				};
+			}
+		};
 
-			const float totalArea{ w0 + w1 + w2 };
-			return { AreEqual(totalArea, triArea, 1.f), w0 / totalArea, w1 / totalArea, w2 / totalArea };
+		// Evaluated exactly at the origin, which keeps the planes precise over the triangle no matter where it is on screen
+		inline BarycentricPlanes SetupBarycentricPlanes(const TriangleEdges& edges, const Vector2i& origin)
+		{
+			const auto setupPlane{ [&](const EdgeFunction& edge) -> InterpolationPlane
+				{
+					return {
+						static_cast<float>(edge.a) * edges.invArea,
+						static_cast<float>(edge.b) * edges.invArea,
+						static_cast<float>(edge.Evaluate(origin.x, origin.y)) * edges.invArea
+					};
+				} };
+
+			return { setupPlane(edges.e0), setupPlane(edges.e1), setupPlane(edges.e2) };
 		}
 
+		// topLeft is inclusive, bottomRight exclusive
 		struct ScreenBoundingBox
 		{
 			Vector2i topLeft{};
 			Vector2i bottomRight{};
 		};
 
-		inline ScreenBoundingBox GetScreenBoundingBox(Vector3 v0, Vector3 v1, Vector3 v2, int width, int height)
-		{
-			// smallest x and y of all vertices
-			Vector2i boundingBoxTopLeft{ Vector2i(
-				static_cast<int>(std::min(v0.x, std::min(v1.x, v2.x))),
-				static_cast<int>(std::min(v0.y, std::min(v1.y, v2.y)))
-			) };
-
-			// largest x and y of all vertices
-			Vector2i boundingBoxBottomRight{ Vector2i(
-				static_cast<int>(std::max(v0.x, std::max(v1.x, v2.x))),
-				static_cast<int>(std::max(v0.y, std::max(v1.y, v2.y)))
-			) };
-
-			boundingBoxTopLeft.x = std::max(boundingBoxTopLeft.x, 0);
-			boundingBoxTopLeft.x = std::min(boundingBoxTopLeft.x, width - 1);
-			boundingBoxTopLeft.y = std::max(boundingBoxTopLeft.y, 0);
-			boundingBoxTopLeft.y = std::min(boundingBoxTopLeft.y, height - 1);
-
-			// Offset by 1 in all directions to make sure there's no gaps
-			boundingBoxTopLeft.x -= 1;
-			boundingBoxTopLeft.y -= 1;
-			boundingBoxBottomRight.x += 1;
-			boundingBoxBottomRight.y += 1;
-
-			boundingBoxTopLeft.x = std::max(boundingBoxTopLeft.x, 0);
-			boundingBoxBottomRight.x = std::min(boundingBoxBottomRight.x, width - 1);
-			boundingBoxTopLeft.y = std::max(boundingBoxTopLeft.y, 0);
-			boundingBoxBottomRight.y = std::min(boundingBoxBottomRight.y, height - 1);
-
-			return { boundingBoxTopLeft, boundingBoxBottomRight };
-		}
-
-		inline bool CheckRange(float x, float y, float z, int xMax, int yMax, float zMax)
+		// Box of all pixels whose centre can lie inside the snapped triangle, clipped to the screen
+		inline ScreenBoundingBox GetScreenBoundingBox(const Vector2i& v0, const Vector2i& v1, const Vector2i& v2, int width, int height)
 		{
-			return x >= 0 && x <= xMax && y >= 0 && y <= yMax && z >= 0 && z <= zMax;
+			constexpr int halfPixel{ SUBPIXEL_SCALE / 2 };
+
+			const int minX{ std::min(v0.x, std::min(v1.x, v2.x)) };
+			const int minY{ std::min(v0.y, std::min(v1.y, v2.y)) };
+			const int maxX{ std::max(v0.x, std::max(v1.x, v2.x)) };
+			const int maxY{ std::max(v0.y, std::max(v1.y, v2.y)) };
+
+			// First pixel centre at or after the minimum, last one at or before the maximum
+			const Vector2i topLeft{
+				static_cast<int>(-FloorDiv(halfPixel - minX, SUBPIXEL_SCALE)),
+				static_cast<int>(-FloorDiv(halfPixel - minY, SUBPIXEL_SCALE))
+			};
+			const Vector2i bottomRight{
+				static_cast<int>(FloorDiv(maxX - halfPixel, SUBPIXEL_SCALE)) + 1,
+				static_cast<int>(FloorDiv(maxY - halfPixel, SUBPIXEL_SCALE)) + 1
+			};
+
+			return {
+				{ std::max(topLeft.x, 0), std::max(topLeft.y, 0) },
+				{ std::min(bottomRight.x, width), std::min(bottomRight.y, height) }
+			};
 		}
 	}
 
 	namespace Utils
 	{
+		// 1-based OBJ indices of one face corner, 0 where the corner has no uv or normal
+		struct ObjVertexKey
+		{
+			size_t position{};
+			size_t uv{};
+			size_t normal{};
+
+			bool operator==(const ObjVertexKey& other) const
+			{
+				return position == other.position && uv == other.uv && normal == other.normal;
+			}
+		};
+
+		struct ObjVertexKeyHash
+		{
+			size_t operator()(const ObjVertexKey& key) const
+			{
+				size_t hash{ std::hash<size_t>{}(key.position) };
+				hash ^= std::hash<size_t>{}(key.uv) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+				hash ^= std::hash<size_t>{}(key.normal) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+				return hash;
+			}
+		};
+
+		inline MeshBounds ComputeBounds(std::span<const Vertex> vertices)
+		{
+			if (vertices.empty()) return {};
+
+			MeshBounds bounds{ vertices[0].position, vertices[0].position };
+			for (const Vertex& vertex : vertices)
+			{
+				bounds.min = { std::min(bounds.min.x, vertex.position.x), std::min(bounds.min.y, vertex.position.y), std::min(bounds.min.z, vertex.position.z) };
+				bounds.max = { std::max(bounds.max.x, vertex.position.x), std::max(bounds.max.y, vertex.position.y), std::max(bounds.max.z, vertex.position.z) };
+			}
+
+			bounds.center = (bounds.min + bounds.max) * 0.5f;
+			for (const Vertex& vertex : vertices)
+			{
+				bounds.radius = std::max(bounds.radius, (vertex.position - bounds.center).Magnitude());
+			}
+
+			return bounds;
+		}
+
 		//Just parses vertices and indices
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
@@ -96,6 +255,9 @@ namespace dae
 			std::vector<Vector3> normals{};
 			std::vector<Vector2> UVs{};
 
+			// Face corners that reference the same position, uv and normal share one vertex
+			std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> vertexLookup{};
+
 			vertices.clear();
 			indices.clear();
 
@@ -141,15 +303,15 @@ namespace dae
 					//add the material index as attibute to the attribute array
 					//
 					// Faces or triangles
-					Vertex vertex{};
-					size_t iPosition, iTexCoord, iNormal;
-
 					uint32_t tempIndices[3];
 					for (size_t iFace = 0; iFace < 3; iFace++)
 					{
+						Vertex vertex{};
+						ObjVertexKey key{};
+
 						// OBJ format uses 1-based arrays
-						file >> iPosition;
-						vertex.position = positions[iPosition - 1];
+						file >> key.position;
+						vertex.position = positions[key.position - 1];
 
 						if ('/' == file.peek())//is next in buffer ==  '/' ?
 						{
@@ -158,8 +320,8 @@ namespace dae
 							if ('/' != file.peek())
 							{
 								// Optional texture coordinate
-								file >> iTexCoord;
-								vertex.uv = UVs[iTexCoord - 1];
+								file >> key.uv;
+								vertex.uv = UVs[key.uv - 1];
 							}
 
 							if ('/' == file.peek())
@@ -167,14 +329,17 @@ namespace dae
 								file.ignore();
 
 								// Optional vertex normal
-								file >> iNormal;
-								vertex.normal = normals[iNormal - 1];
+								file >> key.normal;
+								vertex.normal = normals[key.normal - 1];
 							}
 						}
 
-						vertices.push_back(vertex);
-						tempIndices[iFace] = uint32_t(vertices.size()) - 1;
-						//indices.push_back(uint32_t(vertices.size()) - 1);
+						const auto [it, isNew] { vertexLookup.try_emplace(key, uint32_t(vertices.size())) };
+						if (isNew)
+						{
+							vertices.push_back(vertex);
+						}
+						tempIndices[iFace] = it->second;
 					}
 
 					indices.push_back(tempIndices[0]);
@@ -211,7 +376,12 @@ namespace dae
 				const Vector3 edge1 = p2 - p0;
 				const Vector2 diffX = Vector2(uv1.x - uv0.x, uv2.x - uv0.x);
 				const Vector2 diffY = Vector2(uv1.y - uv0.y, uv2.y - uv0.y);
-				float r = 1.f / Vector2::Cross(diffX, diffY);
+				const float uvArea = Vector2::Cross(diffX, diffY);
+
+				// Faces without UV area have no tangent direction, and the inf or NaN would spread to every face
+				// sharing one of their vertices
+				if (std::abs(uvArea) < 1e-12f) continue;
+				float r = 1.f / uvArea;
 
 				Vector3 tangent = (edge0 * diffY.y - edge1 * diffY.x) * r;
 				vertices[index0].tangent += tangent;
@@ -222,7 +392,15 @@ namespace dae
 			//Fix the tangents per vertex now because we accumulated
 			for (auto& v : vertices)
 			{
-				v.tangent = Vector3::Reject(v.tangent, v.normal).Normalized();
+				v.tangent = Vector3::Reject(v.tangent, v.normal);
+
+				// Vertices without any UV mapped face get some direction in the surface plane, also catches NaN
+				if (!(v.tangent.SqrMagnitude() > 1e-12f))
+				{
+					const Vector3& axis = std::abs(v.normal.x) < .9f ? Vector3::UnitX : Vector3::UnitY;
+					v.tangent = Vector3::Cross(v.normal, axis);
+				}
+				v.tangent.Normalize();
 
 				if(flipAxisAndWinding)
 				{
@@ -236,6 +414,15 @@ namespace dae
 			return true;
 #endif
 		}
+
+		// Parses into the mesh and computes its bounds
+		static bool ParseOBJ(const std::string& filename, Mesh& mesh, bool flipAxisAndWinding = true)
+		{
+			if (!ParseOBJ(filename, mesh.vertices, mesh.indices, flipAxisAndWinding)) return false;
+
+			mesh.bounds = ComputeBounds(mesh.vertices);
+			return true;
+		}
 #pragma warning(pop)
 	}
 }
\ No newline at end of file
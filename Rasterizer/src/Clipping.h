@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "DataTypes.h"
+#include "Maths.h"
+#include "Shaders.h"
+
+namespace dae
+{
+	namespace Clipping
+	{
+		// Outcodes of a clip space position, one bit per plane the position lies outside of
+		enum ClipFlags : uint8_t
+		{
+			CLIP_NONE = 0,
+
+			// Visible frustum, triangles fully outside one of these are trivially rejected
+			CLIP_LEFT = 1 << 0,
+			CLIP_RIGHT = 1 << 1,
+			CLIP_BOTTOM = 1 << 2,
+			CLIP_TOP = 1 << 3,
+			CLIP_NEAR = 1 << 4,
+			CLIP_FAR = 1 << 5,
+			CLIP_FRUSTUM = CLIP_LEFT | CLIP_RIGHT | CLIP_BOTTOM | CLIP_TOP | CLIP_NEAR | CLIP_FAR,
+
+			// Guard band, triangles crossing it have to be clipped to stay within the rasterizer's fixed point range.
+			// Set outside either side, so unlike the frustum bits they can't be combined to find a shared side.
+			CLIP_GUARD_X = 1 << 6,
+			CLIP_GUARD_Y = 1 << 7,
+
+			// Anything that isn't solved by clamping the bounding box to the viewport
+			CLIP_MUST_CLIP = CLIP_NEAR | CLIP_FAR | CLIP_GUARD_X | CLIP_GUARD_Y
+		};
+
+		// Extra pixels past each screen edge that are still rasterized without clipping
+		constexpr int GUARD_BAND_SIZE{ 2048 };
+
+		// A polygon never gains more than one vertex per plane it is clipped against
+		constexpr int MAX_POLYGON_VERTICES{ 3 + 6 };
+
+		// Carries the shader's varyings, unused ones are interpolated along without harm
+		struct ClipVertex
+		{
+			Vector4 position{};
+			std::array<float, VARYING_CAPACITY> varyings{};
+		};
+
+		// guardBand is the guard band's half extent in NDC units
+		uint8_t ComputeClipFlags(const Vector4& clipPos, float guardBandX, float guardBandY);
+
+		// World space planes of the visible frustum as (normal, distance), normals point inwards
+		struct Frustum
+		{
+			Vector4 planes[6]{};
+		};
+
+		// Pulls the planes out of the columns of a combined view projection matrix
+		Frustum ExtractFrustum(const Matrix& viewProjection);
+
+		// Tests the bounding sphere and then the box, both moved to world space. Conservative: bounds that only
+		// graze the frustum near its edges can still pass.
+		bool IsOutsideFrustum(const Frustum& frustum, const MeshBounds& bounds, const Matrix& world);
+
+		// Clips a convex polygon in clip space against the near and far planes and the guard band,
+		// writes the result to pOut and returns its vertex count
+		int ClipPolygon(
+			const ClipVertex* pIn, int count,
+			uint8_t clipFlags,
+			float guardBandX, float guardBandY,
+			ClipVertex* pOut
+		);
+	}
+}
@@ -0,0 +1,152 @@
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Project includes
+#include "FrameBuffer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cfloat>
+#include <emmintrin.h>
+
+using namespace dae;
+
+namespace
+{
+	// Pixels per row are padded to a multiple of this, which keeps every row 64 byte aligned
+	constexpr int STRIDE_ALIGNMENT{ 16 };
+
+	template<typename T>
+	T* AllocatePlane(size_t count)
+	{
+		return static_cast<T*>(SDL_SIMDAlloc(count * sizeof(T)));
+	}
+
+	void FillRow(uint32_t* pRow, int count, uint32_t value, bool useStreamingStores)
+	{
+		if (!useStreamingStores)
+		{
+			std::fill_n(pRow, count, value);
+			return;
+		}
+
+		int i{ 0 };
+		for (; i < count && (reinterpret_cast<uintptr_t>(pRow + i) & 15) != 0; ++i)
+		{
+			pRow[i] = value;
+		}
+
+		const __m128i values{ _mm_set1_epi32(static_cast<int>(value)) };
+		for (; i + 4 <= count; i += 4)
+		{
+			_mm_stream_si128(reinterpret_cast<__m128i*>(pRow + i), values);
+		}
+
+		for (; i < count; ++i)
+		{
+			pRow[i] = value;
+		}
+	}
+}
+
+FrameBuffer::~FrameBuffer()
+{
+	Release();
+}
+
+void FrameBuffer::Resize(int width, int height)
+{
+	if (width == m_Width && height == m_Height) return;
+
+	Release();
+
+	m_Width = width;
+	m_Height = height;
+	m_Stride = (width + STRIDE_ALIGNMENT - 1) / STRIDE_ALIGNMENT * STRIDE_ALIGNMENT;
+	m_BlockCountX = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	const size_t pixelCount{ static_cast<size_t>(m_Stride) * static_cast<size_t>(height) };
+	const size_t blockCount{ static_cast<size_t>(m_BlockCountX) * static_cast<size_t>((height + BLOCK_SIZE - 1) / BLOCK_SIZE) };
+
+	m_pColor = AllocatePlane<uint32_t>(pixelCount);
+	m_pDepth = AllocatePlane<float>(pixelCount);
+	m_pVisibility = AllocatePlane<uint32_t>(pixelCount);
+	m_pBlockMaxDepth = AllocatePlane<float>(blockCount);
+
+	m_pSurface = SDL_CreateRGBSurfaceWithFormatFrom(
+		m_pColor,
+		width, height,
+		32,
+		m_Stride * static_cast<int>(sizeof(uint32_t)),
+		SDL_PIXELFORMAT_RGB888
+	);
+
+	// Resolved once here so pixels can be packed without going through SDL_MapRGB
+	const SDL_PixelFormat* pFormat{ m_pSurface->format };
+	m_PackedFormat = { pFormat->Rshift, pFormat->Gshift, pFormat->Bshift, pFormat->Amask };
+}
+
+void FrameBuffer::WriteColorSpan(int px, int py, const RasterKernels::ColorSpan& colors, uint32_t mask) const
+{
+	uint32_t packed[RasterKernels::SPAN_WIDTH];
+	RasterKernels::PackColorSpan(colors, m_PackedFormat, packed);
+
+	uint32_t* pPixels{ m_pColor + px + py * m_Stride };
+
+	constexpr uint32_t fullMask{ (1u << RasterKernels::SPAN_WIDTH) - 1u };
+	if (mask == fullMask)
+	{
+		std::copy_n(packed, RasterKernels::SPAN_WIDTH, pPixels);
+		return;
+	}
+
+	while (mask != 0)
+	{
+		const int lane{ std::countr_zero(mask) };
+		mask &= mask - 1;
+
+		pPixels[lane] = packed[lane];
+	}
+}
+
+void FrameBuffer::ClearTile(const GeometryUtils::ScreenBoundingBox& bound, uint32_t clearColor, bool useStreamingStores) const
+{
+	const int width{ bound.bottomRight.x - bound.topLeft.x };
+	const uint32_t clearDepth{ std::bit_cast<uint32_t>(FLT_MAX) };
+
+	for (int py{ bound.topLeft.y }; py < bound.bottomRight.y; ++py)
+	{
+		const int rowStart{ bound.topLeft.x + py * m_Stride };
+
+		FillRow(m_pColor + rowStart, width, clearColor, useStreamingStores);
+		FillRow(reinterpret_cast<uint32_t*>(m_pDepth) + rowStart, width, clearDepth, useStreamingStores);
+		FillRow(m_pVisibility + rowStart, width, INVALID_TRIANGLE, useStreamingStores);
+	}
+
+	// Tiles are aligned to blocks, so this only touches the tile's own blocks
+	const int firstBlockX{ bound.topLeft.x / BLOCK_SIZE };
+	const int endBlockX{ (bound.bottomRight.x + BLOCK_SIZE - 1) / BLOCK_SIZE };
+	for (int blockY{ bound.topLeft.y / BLOCK_SIZE }; blockY < (bound.bottomRight.y + BLOCK_SIZE - 1) / BLOCK_SIZE; ++blockY)
+	{
+		std::fill(m_pBlockMaxDepth + firstBlockX + blockY * m_BlockCountX, m_pBlockMaxDepth + endBlockX + blockY * m_BlockCountX, FLT_MAX);
+	}
+
+	// Streaming stores are weakly ordered, make them visible before another thread blits or draws the tile
+	if (useStreamingStores) _mm_sfence();
+}
+
+void FrameBuffer::Release()
+{
+	SDL_FreeSurface(m_pSurface);
+	SDL_SIMDFree(m_pColor);
+	SDL_SIMDFree(m_pDepth);
+	SDL_SIMDFree(m_pVisibility);
+	SDL_SIMDFree(m_pBlockMaxDepth);
+
+	m_pSurface = nullptr;
+	m_pColor = nullptr;
+	m_pDepth = nullptr;
+	m_pVisibility = nullptr;
+	m_pBlockMaxDepth = nullptr;
+}
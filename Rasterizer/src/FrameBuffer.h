@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+
+#include "RasterKernels.h"
+#include "Utils.h"
+
+struct SDL_Surface;
+
+namespace dae
+{
+	// Color, depth and visibility planes that live across frames. Rows are padded to a SIMD friendly stride,
+	// and the color plane is wrapped in an SDL surface so it can be blitted without a copy.
+	class FrameBuffer final
+	{
+	public:
+		// Max depth is kept per block of the rasterizer
+		static constexpr int BLOCK_SIZE{ RasterKernels::SPAN_WIDTH };
+
+		static constexpr uint32_t INVALID_TRIANGLE{ UINT32_MAX };
+
+		FrameBuffer() = default;
+		~FrameBuffer();
+
+		FrameBuffer(const FrameBuffer&) = delete;
+		FrameBuffer(FrameBuffer&&) noexcept = delete;
+		FrameBuffer& operator=(const FrameBuffer&) = delete;
+		FrameBuffer& operator=(FrameBuffer&&) noexcept = delete;
+
+		// Only reallocates when the size actually changes, the contents are undefined afterwards
+		void Resize(int width, int height);
+
+		// Packs the span and writes the lanes set in mask to the color plane, starting at (px, py)
+		void WriteColorSpan(int px, int py, const RasterKernels::ColorSpan& colors, uint32_t mask) const;
+
+		// Resets every plane within the box. Streaming stores bypass the cache, which suits tiles that won't be drawn to this frame.
+		void ClearTile(const GeometryUtils::ScreenBoundingBox& bound, uint32_t clearColor, bool useStreamingStores) const;
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+
+		// Row stride of the color, depth and visibility planes in pixels, the color surface's pitch
+		int GetStride() const { return m_Stride; }
+		int GetBlockStride() const { return m_BlockCountX; }
+
+		uint32_t* GetColor() const { return m_pColor; }
+		float* GetDepth() const { return m_pDepth; }
+		uint32_t* GetVisibility() const { return m_pVisibility; }
+		float* GetBlockMaxDepth() const { return m_pBlockMaxDepth; }
+
+		SDL_Surface* GetSurface() const { return m_pSurface; }
+
+	private:
+		int m_Width{};
+		int m_Height{};
+		int m_Stride{};
+		int m_BlockCountX{};
+
+		uint32_t* m_pColor{ nullptr };
+		float* m_pDepth{ nullptr };
+		uint32_t* m_pVisibility{ nullptr };
+		float* m_pBlockMaxDepth{ nullptr };
+
+		SDL_Surface* m_pSurface{ nullptr };
+		RasterKernels::PackedFormat m_PackedFormat{};
+
+		void Release();
+	};
+}
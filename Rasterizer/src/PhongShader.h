@@ -0,0 +1,118 @@
+#pragma once
+
+#include "BRDFs.h"
+#include "DataTypes.h"
+#include "Maths.h"
+#include "Shaders.h"
+#include "Texture.h"
+#include "VertexPacking.h"
+
+#include <cstddef>
+
+namespace dae
+{
+	// Normal mapped Lambert diffuse and Phong specular under a single directional light.
+	// The shading mode picks which of the terms make it into the result.
+	struct PhongShader final
+	{
+		struct Varyings
+		{
+			Vector2 uv;
+			Vector3 normal;
+
+			// From the camera to the surface, unnormalized so it interpolates like the world position
+			Vector3 viewVector;
+			ColorRGB color;
+
+			// Last, so it can be left out when normal mapping is off
+			Vector3 tangent;
+		};
+
+		static constexpr size_t TEXCOORD_VARYING{ offsetof(Varyings, uv) / sizeof(float) };
+		static constexpr size_t NORMAL_MAP_VARYINGS{ 3 };
+
+		static Varyings ShadeVertex(const Vertex_Out& vertex, const ShadingContext& context)
+		{
+			return {
+				vertex.uv,
+				UnpackOctahedral(vertex.normal),
+				vertex.worldPosition - context.cameraOrigin,
+				vertex.color,
+				UnpackOctahedral(vertex.tangent)
+			};
+		}
+
+		template<typename State>
+		static ColorRGB ShadePixel(const Varyings& varyings, const TextureCoordinate& texCoord, const ShadingContext& context,
+			const Material& material)
+		{
+			const Vector3 lightDirection{ .577f, -.577f, .577f };
+
+			// Normal
+			const Vector3 vertexNormal{ varyings.normal.Normalized() };
+			Vector3 normal{ vertexNormal };
+			if constexpr (State::usingNormalMap)
+			{
+				const Vector3 tangent{ varyings.tangent.Normalized() };
+				const Vector3 binormal{ Vector3::Cross(vertexNormal, tangent) };
+				const Matrix tangentSpaceAxis{ tangent, binormal, vertexNormal, Vector3::Zero };
+
+				const ColorRGB normalMapSample{ material.pNormal->Sample(texCoord, context.textureFilter) };
+				normal = normalMapSample.ToVector3() * 2.f - Vector3::One;
+				normal = tangentSpaceAxis.TransformPoint(normal);
+				normal.Normalize();
+			}
+
+			const float observedArea{ Vector3::Dot(normal, -lightDirection) };
+			if (observedArea <= 0)
+			{
+				return colors::Black;
+			}
+
+			constexpr float lightIntensity{ 7.f };
+			constexpr float shininess{ 25.f };
+			const ColorRGB ambient{ .03f, .03f, .03f };
+
+			// Diffuse
+			ColorRGB diffuse{};
+			if constexpr (State::usesDiffuse)
+			{
+				const ColorRGB diffuseMapSample{ material.pDiffuse->Sample(texCoord, context.textureFilter) };
+				diffuse = BRDF::Lambert(1.f, diffuseMapSample * varyings.color);
+			}
+
+			ColorRGB specular{};
+			if constexpr (State::usesSpecular)
+			{
+				const ColorRGB specularMapSample{ material.pSpecular->Sample(texCoord, context.textureFilter) };
+				const ColorRGB glossinessMapSample{ material.pGloss->Sample(texCoord, context.textureFilter) };
+				const ColorRGB glossiness{ glossinessMapSample * shininess };
+
+				specular = BRDF::Phong(
+					specularMapSample,
+					glossiness,
+					lightDirection,
+					varyings.viewVector.Normalized(),
+					normal
+				);
+			}
+
+			if constexpr (State::usesDiffuse && State::usesSpecular)
+			{
+				return ((colors::White * lightIntensity * diffuse) + ambient + specular) * observedArea;
+			}
+			else if constexpr (State::usesDiffuse)
+			{
+				return colors::White * lightIntensity * diffuse * observedArea;
+			}
+			else if constexpr (State::usesSpecular)
+			{
+				return specular;
+			}
+			else
+			{
+				return ColorRGB{ observedArea,observedArea,observedArea };
+			}
+		}
+	};
+}
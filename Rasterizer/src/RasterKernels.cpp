@@ -0,0 +1,258 @@
+#include "RasterKernels.h"
+
+#include <algorithm>
+#include <immintrin.h>
+
+#include "SDL_cpuinfo.h"
+
+using namespace dae;
+
+namespace
+{
+	constexpr float LANE_OFFSETS[RasterKernels::SPAN_WIDTH]{ 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f };
+
+	template<bool TestCoverage>
+	uint32_t SpanKernel_SSE41_4(const RasterKernels::SpanSetup& span, int laneOffset, int count, float* pDepth, RasterKernels::SpanFragments& fragments)
+	{
+		const __m128 offsets{ _mm_loadu_ps(LANE_OFFSETS + laneOffset) };
+		const __m128i laneIndices{ _mm_setr_epi32(laneOffset, laneOffset + 1, laneOffset + 2, laneOffset + 3) };
+		const __m128 e0{ _mm_add_ps(_mm_set1_ps(span.e0), _mm_mul_ps(offsets, _mm_set1_ps(span.stepE0))) };
+		const __m128 e1{ _mm_add_ps(_mm_set1_ps(span.e1), _mm_mul_ps(offsets, _mm_set1_ps(span.stepE1))) };
+		const __m128 e2{ _mm_add_ps(_mm_set1_ps(span.e2), _mm_mul_ps(offsets, _mm_set1_ps(span.stepE2))) };
+
+		const uint32_t laneMask{ (1u << count) - 1u };
+
+		__m128 inside{ _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+		if constexpr (TestCoverage)
+		{
+			const __m128i c0{ _mm_add_epi32(_mm_set1_epi32(span.coverage0), _mm_mullo_epi32(laneIndices, _mm_set1_epi32(span.coverageStep0))) };
+			const __m128i c1{ _mm_add_epi32(_mm_set1_epi32(span.coverage1), _mm_mullo_epi32(laneIndices, _mm_set1_epi32(span.coverageStep1))) };
+			const __m128i c2{ _mm_add_epi32(_mm_set1_epi32(span.coverage2), _mm_mullo_epi32(laneIndices, _mm_set1_epi32(span.coverageStep2))) };
+
+			// The sign bit of the combined values is set if any edge value is negative
+			const __m128i combined{ _mm_or_si128(_mm_or_si128(c0, c1), c2) };
+			inside = _mm_castsi128_ps(_mm_cmpgt_epi32(combined, _mm_set1_epi32(-1)));
+			if ((_mm_movemask_ps(inside) & laneMask) == 0) return 0;
+		}
+
+		const __m128 invArea{ _mm_set1_ps(span.invArea) };
+		const __m128 w0{ _mm_mul_ps(e0, invArea) };
+		const __m128 w1{ _mm_mul_ps(e1, invArea) };
+		const __m128 w2{ _mm_mul_ps(e2, invArea) };
+
+		const __m128 invViewDepth{ _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(w0, _mm_set1_ps(span.invW0)),
+			_mm_mul_ps(w1, _mm_set1_ps(span.invW1))),
+			_mm_mul_ps(w2, _mm_set1_ps(span.invW2))) };
+		const __m128 viewDepth{ _mm_div_ps(_mm_set1_ps(1.f), invViewDepth) };
+
+		// Partial spans go through a copy so we never touch memory past the end of the row
+		float depthCopy[4]{};
+		float* pDepthLanes{ pDepth };
+		if (count < 4)
+		{
+			for (int i{ 0 }; i < count; ++i) depthCopy[i] = pDepth[i];
+			pDepthLanes = depthCopy;
+		}
+
+		const __m128 storedDepth{ _mm_loadu_ps(pDepthLanes) };
+		const __m128 visible{ _mm_and_ps(inside, _mm_cmpge_ps(storedDepth, viewDepth)) };
+		const uint32_t mask{ static_cast<uint32_t>(_mm_movemask_ps(visible)) & laneMask };
+		if (mask == 0) return 0;
+
+		_mm_storeu_ps(pDepthLanes, _mm_blendv_ps(storedDepth, viewDepth, visible));
+		if (pDepthLanes != pDepth)
+		{
+			for (int i{ 0 }; i < count; ++i) pDepth[i] = depthCopy[i];
+		}
+
+		_mm_storeu_ps(fragments.w0 + laneOffset, w0);
+		_mm_storeu_ps(fragments.w1 + laneOffset, w1);
+		_mm_storeu_ps(fragments.w2 + laneOffset, w2);
+		_mm_storeu_ps(fragments.viewDepth + laneOffset, viewDepth);
+
+		return mask << laneOffset;
+	}
+
+	template<bool TestCoverage>
+	uint32_t SpanKernel_Scalar(const RasterKernels::SpanSetup& span, int count, float* pDepth, RasterKernels::SpanFragments& fragments)
+	{
+		uint32_t mask{};
+
+		int32_t c0{ span.coverage0 };
+		int32_t c1{ span.coverage1 };
+		int32_t c2{ span.coverage2 };
+
+		float e0{ span.e0 };
+		float e1{ span.e1 };
+		float e2{ span.e2 };
+
+		for (int i{ 0 }; i < count; ++i)
+		{
+			if (!TestCoverage || (c0 >= 0 && c1 >= 0 && c2 >= 0))
+			{
+				const float w0{ e0 * span.invArea };
+				const float w1{ e1 * span.invArea };
+				const float w2{ e2 * span.invArea };
+				const float viewDepth{ 1.f / (w0 * span.invW0 + w1 * span.invW1 + w2 * span.invW2) };
+
+				if (pDepth[i] >= viewDepth)
+				{
+					pDepth[i] = viewDepth;
+
+					fragments.w0[i] = w0;
+					fragments.w1[i] = w1;
+					fragments.w2[i] = w2;
+					fragments.viewDepth[i] = viewDepth;
+					mask |= 1u << i;
+				}
+			}
+
+			c0 += span.coverageStep0;
+			c1 += span.coverageStep1;
+			c2 += span.coverageStep2;
+
+			e0 += span.stepE0;
+			e1 += span.stepE1;
+			e2 += span.stepE2;
+		}
+
+		return mask;
+	}
+
+	template<bool TestCoverage>
+	uint32_t SpanKernel_SSE41(const RasterKernels::SpanSetup& span, int count, float* pDepth, RasterKernels::SpanFragments& fragments)
+	{
+		uint32_t mask{ SpanKernel_SSE41_4<TestCoverage>(span, 0, std::min(count, 4), pDepth, fragments) };
+		if (count > 4)
+		{
+			mask |= SpanKernel_SSE41_4<TestCoverage>(span, 4, count - 4, pDepth + 4, fragments);
+		}
+		return mask;
+	}
+
+	template<bool TestCoverage>
+	uint32_t SpanKernel_AVX2(const RasterKernels::SpanSetup& span, int count, float* pDepth, RasterKernels::SpanFragments& fragments)
+	{
+		const __m256 offsets{ _mm256_loadu_ps(LANE_OFFSETS) };
+		const __m256 e0{ _mm256_add_ps(_mm256_set1_ps(span.e0), _mm256_mul_ps(offsets, _mm256_set1_ps(span.stepE0))) };
+		const __m256 e1{ _mm256_add_ps(_mm256_set1_ps(span.e1), _mm256_mul_ps(offsets, _mm256_set1_ps(span.stepE1))) };
+		const __m256 e2{ _mm256_add_ps(_mm256_set1_ps(span.e2), _mm256_mul_ps(offsets, _mm256_set1_ps(span.stepE2))) };
+
+		// Lanes past count are masked out of the depth load and store
+		const __m256i laneIndices{ _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7) };
+		const __m256i inRange{ _mm256_cmpgt_epi32(_mm256_set1_epi32(count), laneIndices) };
+
+		__m256 candidates{ _mm256_castsi256_ps(inRange) };
+		if constexpr (TestCoverage)
+		{
+			const __m256i c0{ _mm256_add_epi32(_mm256_set1_epi32(span.coverage0), _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(span.coverageStep0))) };
+			const __m256i c1{ _mm256_add_epi32(_mm256_set1_epi32(span.coverage1), _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(span.coverageStep1))) };
+			const __m256i c2{ _mm256_add_epi32(_mm256_set1_epi32(span.coverage2), _mm256_mullo_epi32(laneIndices, _mm256_set1_epi32(span.coverageStep2))) };
+
+			// The sign bit of the combined values is set if any edge value is negative
+			const __m256i combined{ _mm256_or_si256(_mm256_or_si256(c0, c1), c2) };
+			const __m256 inside{ _mm256_castsi256_ps(_mm256_cmpgt_epi32(combined, _mm256_set1_epi32(-1))) };
+
+			candidates = _mm256_and_ps(inside, candidates);
+			if (_mm256_testz_ps(candidates, candidates)) return 0;
+		}
+
+		const __m256 invArea{ _mm256_set1_ps(span.invArea) };
+		const __m256 w0{ _mm256_mul_ps(e0, invArea) };
+		const __m256 w1{ _mm256_mul_ps(e1, invArea) };
+		const __m256 w2{ _mm256_mul_ps(e2, invArea) };
+
+		const __m256 invViewDepth{ _mm256_add_ps(_mm256_add_ps(
+			_mm256_mul_ps(w0, _mm256_set1_ps(span.invW0)),
+			_mm256_mul_ps(w1, _mm256_set1_ps(span.invW1))),
+			_mm256_mul_ps(w2, _mm256_set1_ps(span.invW2))) };
+		const __m256 viewDepth{ _mm256_div_ps(_mm256_set1_ps(1.f), invViewDepth) };
+
+		const __m256 storedDepth{ _mm256_maskload_ps(pDepth, inRange) };
+		const __m256 visible{ _mm256_and_ps(candidates, _mm256_cmp_ps(storedDepth, viewDepth, _CMP_GE_OQ)) };
+		const uint32_t mask{ static_cast<uint32_t>(_mm256_movemask_ps(visible)) };
+		if (mask == 0) return 0;
+
+		_mm256_maskstore_ps(pDepth, _mm256_castps_si256(visible), viewDepth);
+
+		_mm256_storeu_ps(fragments.w0, w0);
+		_mm256_storeu_ps(fragments.w1, w1);
+		_mm256_storeu_ps(fragments.w2, w2);
+		_mm256_storeu_ps(fragments.viewDepth, viewDepth);
+
+		return mask;
+	}
+}
+
+uint32_t RasterKernels::CoverageDepth_Scalar(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments)
+{
+	return SpanKernel_Scalar<true>(span, count, pDepth, fragments);
+}
+
+uint32_t RasterKernels::Depth_Scalar(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments)
+{
+	return SpanKernel_Scalar<false>(span, count, pDepth, fragments);
+}
+
+uint32_t RasterKernels::CoverageDepth_SSE41(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments)
+{
+	return SpanKernel_SSE41<true>(span, count, pDepth, fragments);
+}
+
+uint32_t RasterKernels::Depth_SSE41(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments)
+{
+	return SpanKernel_SSE41<false>(span, count, pDepth, fragments);
+}
+
+uint32_t RasterKernels::CoverageDepth_AVX2(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments)
+{
+	return SpanKernel_AVX2<true>(span, count, pDepth, fragments);
+}
+
+uint32_t RasterKernels::Depth_AVX2(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments)
+{
+	return SpanKernel_AVX2<false>(span, count, pDepth, fragments);
+}
+
+RasterKernels::SpanKernels RasterKernels::SelectSpanKernels()
+{
+	if (SDL_HasAVX2()) return { &CoverageDepth_AVX2, &Depth_AVX2 };
+	if (SDL_HasSSE41()) return { &CoverageDepth_SSE41, &Depth_SSE41 };
+	return { &CoverageDepth_Scalar, &Depth_Scalar };
+}
+
+void RasterKernels::PackColorSpan(const ColorSpan& colors, const PackedFormat& format, uint32_t* pPixels)
+{
+	const __m128i rShift{ _mm_cvtsi32_si128(format.rShift) };
+	const __m128i gShift{ _mm_cvtsi32_si128(format.gShift) };
+	const __m128i bShift{ _mm_cvtsi32_si128(format.bShift) };
+	const __m128i alpha{ _mm_set1_epi32(static_cast<int>(format.alphaMask)) };
+
+	const __m128 zero{ _mm_setzero_ps() };
+	const __m128 one{ _mm_set1_ps(1.f) };
+	const __m128 maxByte{ _mm_set1_ps(255.f) };
+
+	for (int lane{ 0 }; lane < SPAN_WIDTH; lane += 4)
+	{
+		// Negative and NaN channels become zero
+		const __m128 r{ _mm_max_ps(_mm_loadu_ps(colors.r + lane), zero) };
+		const __m128 g{ _mm_max_ps(_mm_loadu_ps(colors.g + lane), zero) };
+		const __m128 b{ _mm_max_ps(_mm_loadu_ps(colors.b + lane), zero) };
+
+		const __m128 maxValue{ _mm_max_ps(r, _mm_max_ps(g, b)) };
+		const __m128 scale{ _mm_div_ps(maxByte, _mm_max_ps(maxValue, one)) };
+
+		const __m128i rBytes{ _mm_cvttps_epi32(_mm_mul_ps(r, scale)) };
+		const __m128i gBytes{ _mm_cvttps_epi32(_mm_mul_ps(g, scale)) };
+		const __m128i bBytes{ _mm_cvttps_epi32(_mm_mul_ps(b, scale)) };
+
+		const __m128i packed{
+			_mm_or_si128(
+				_mm_or_si128(_mm_sll_epi32(rBytes, rShift), _mm_sll_epi32(gBytes, gShift)),
+				_mm_or_si128(_mm_sll_epi32(bBytes, bShift), alpha)
+			)
+		};
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(pPixels + lane), packed);
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+
+namespace dae
+{
+	namespace RasterKernels
+	{
+		constexpr int SPAN_WIDTH{ 8 };
+
+		// Edge and depth state at the first pixel centre of a row segment
+		struct SpanSetup
+		{
+			// Integer edge values whose signs decide coverage, exact for subpixel snapped triangles
+			int32_t coverage0{};
+			int32_t coverage1{};
+			int32_t coverage2{};
+
+			int32_t coverageStep0{};
+			int32_t coverageStep1{};
+			int32_t coverageStep2{};
+
+			// The same edge values as floats, normalized by invArea into barycentric weights
+			float e0{};
+			float e1{};
+			float e2{};
+
+			// Edge increments for one pixel step in x
+			float stepE0{};
+			float stepE1{};
+			float stepE2{};
+
+			float invArea{};
+
+			// Reciprocal view depth of the triangle's vertices
+			float invW0{};
+			float invW1{};
+			float invW2{};
+		};
+
+		// Per-lane results, only valid for lanes set in the returned mask
+		struct SpanFragments
+		{
+			float w0[SPAN_WIDTH]{};
+			float w1[SPAN_WIDTH]{};
+			float w2[SPAN_WIDTH]{};
+			float viewDepth[SPAN_WIDTH]{};
+		};
+
+		// Tests up to SPAN_WIDTH pixels against the triangle edges and the depth buffer.
+		// Depth is written for every pixel that passes, and those pixels are returned as a lane mask.
+		using SpanKernel = uint32_t(*)(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+
+		uint32_t CoverageDepth_Scalar(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+		uint32_t CoverageDepth_SSE41(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+		uint32_t CoverageDepth_AVX2(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+
+		// Same as CoverageDepth, for spans already known to lie fully inside the triangle
+		uint32_t Depth_Scalar(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+		uint32_t Depth_SSE41(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+		uint32_t Depth_AVX2(const SpanSetup& span, int count, float* pDepth, SpanFragments& fragments);
+
+		struct SpanKernels
+		{
+			SpanKernel coverageDepth{ &CoverageDepth_Scalar };
+			SpanKernel depth{ &Depth_Scalar };
+		};
+
+		// Picks the widest kernels the CPU running the binary supports
+		SpanKernels SelectSpanKernels();
+
+		// Shaded colors of a span, not yet brought into [0, 1]
+		struct ColorSpan
+		{
+			float r[SPAN_WIDTH]{};
+			float g[SPAN_WIDTH]{};
+			float b[SPAN_WIDTH]{};
+		};
+
+		// Channel layout of a 32-bit surface format with 8 bits per channel, resolved once from its SDL_PixelFormat
+		struct PackedFormat
+		{
+			int rShift{};
+			int gShift{};
+			int bShift{};
+			uint32_t alphaMask{};
+		};
+
+		// Scales colors brighter than one down like ColorRGB::MaxToOne and packs all SPAN_WIDTH lanes into pPixels.
+		// Only needs SSE2, which every x64 CPU has.
+		void PackColorSpan(const ColorSpan& colors, const PackedFormat& format, uint32_t* pPixels);
+	}
+}
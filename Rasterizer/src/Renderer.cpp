@@ -5,25 +5,45 @@
 //Project includes
 #include "Renderer.h"
 
+#include <algorithm>
+#include <bit>
 #include <iostream>
 
-#include "BRDFs.h"
+#include "Clipping.h"
 #include "Maths.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include "Texture.h"
 #include "Utils.h"
 
 using namespace dae;
 
+namespace
+{
+	// Largest axis scale of a world matrix, what a bounding sphere's radius grows by
+	float GetMaxScale(const Matrix& world)
+	{
+		return std::max({ world.GetAxisX().Magnitude(), world.GetAxisY().Magnitude(), world.GetAxisZ().Magnitude() });
+	}
+
+	TransformKernels::TransformOutput GetTransformOutput(Mesh& mesh)
+	{
+		return { mesh.verticesOut.data(), mesh.clipPositions.data(), mesh.clipFlags.data(), mesh.varyingsOut.data() };
+	}
+}
+
 Renderer::Renderer(SDL_Window* pWindow) :
 	m_pWindow(pWindow)
 {
 	//Initialize
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
+	int width{}, height{};
+	SDL_GetWindowSize(pWindow, &width, &height);
 
 	//Create Buffers
-	m_pFrontBuffer = SDL_GetWindowSurface(pWindow);
-	m_pBackBuffer = SDL_CreateRGBSurface(0, m_Width, m_Height, 32, 0, 0, 0, 0);
-	m_pBackBufferPixels = static_cast<uint32_t*>(m_pBackBuffer->pixels);
+	Resize(width, height);
+
+	m_SpanKernels = RasterKernels::SelectSpanKernels();
+	m_TransformKernels = TransformKernels::SelectStageKernels();
 
 	//Initialize Camera
 	m_Camera.Initialize(
@@ -33,9 +53,32 @@ Renderer::Renderer(SDL_Window* pWindow) :
 	);
 
 	Mesh vehicle{};
-	vehicle.worldMatrix = Matrix::CreateTranslation(0, 0, 50.f);
+	vehicle.SetWorldMatrix(Matrix::CreateTranslation(0, 0, 50.f));
+
+	Utils::ParseOBJ("../_Resources/vehicle.obj", vehicle);
+
+	if (OPTIMIZE_MESHES)
+	{
+		const MeshOptimizer::OptimizationResult result{ MeshOptimizer::OptimizeMesh(vehicle) };
+		std::cout << "vehicle.obj ACMR: " << result.acmrBefore << " -> " << result.acmrAfter << '\n';
+	}
+
+	if (BUILD_MESHLETS)
+	{
+		MeshOptimizer::BuildMeshlets(vehicle);
+		std::cout << "vehicle.obj meshlets: " << vehicle.meshlets.size() << '\n';
+	}
 
-	Utils::ParseOBJ("../_Resources/vehicle.obj", vehicle.vertices, vehicle.indices);
+	if (BUILD_LODS)
+	{
+		MeshSimplifier::BuildLods(vehicle);
+		std::cout << "vehicle.obj LODs:";
+		for (const MeshLod& lod : vehicle.lods)
+		{
+			std::cout << ' ' << lod.indices.size() / 3;
+		}
+		std::cout << " triangles\n";
+	}
 
 	m_SceneMeshes = {
 		vehicle
@@ -47,6 +90,35 @@ Renderer::Renderer(SDL_Window* pWindow) :
 		"../_Resources/vehicle_specular.png",
 		"../_Resources/vehicle_gloss.png"
 	);
+
+	if (FLEET_SIZE > 0)
+	{
+		const ColorRGB tints[]{ colors::White, { 1.f, .6f, .5f }, { .5f, .8f, 1.f }, { .7f, 1.f, .6f } };
+
+		// Small tinted copies on a grid below the vehicle, spaced a bit wider than their bounds
+		constexpr float scale{ .2f };
+		const Matrix scaling{ Matrix::CreateScale(scale, scale, scale) };
+		const float spacing{ vehicle.bounds.radius * scale * 2.5f };
+		const float height{ -vehicle.bounds.radius };
+
+		std::vector<MeshInstance> fleet{};
+		for (int row{ 0 }; row < FLEET_SIZE; ++row)
+		{
+			for (int column{ 0 }; column < FLEET_SIZE; ++column)
+			{
+				const float x{ (static_cast<float>(column) - static_cast<float>(FLEET_SIZE - 1) * .5f) * spacing };
+				const float z{ (static_cast<float>(row) - static_cast<float>(FLEET_SIZE - 1) * .5f) * spacing };
+				const float yaw{ static_cast<float>(row * FLEET_SIZE + column) * PI_DIV_4 };
+
+				fleet.push_back({
+					scaling * Matrix::CreateRotationY(yaw) * Matrix::CreateTranslation(x, height, z),
+					tints[(row + column) % 4]
+				});
+			}
+		}
+
+		AddInstancedMesh(std::move(vehicle), std::move(fleet));
+	}
 }
 
 Renderer::~Renderer()
@@ -68,119 +140,307 @@ void Renderer::Update(const Timer* pTimer)
 
 	const Matrix rotation{ Matrix::CreateRotationY(m_CurrentRotation) };
 
-	m_SceneMeshes[0].worldMatrix = rotation;
+	m_SceneMeshes[0].SetWorldMatrix(rotation);
 }
 
 void Renderer::Render()
 {
 	//@START
-	//Lock BackBuffer
-	SDL_LockSurface(m_pBackBuffer);
+	int width{}, height{};
+	SDL_GetWindowSize(m_pWindow, &width, &height);
+	if (width != m_Width || height != m_Height) Resize(width, height);
 
-	const size_t pixelCount{ static_cast<size_t>(m_Width) * static_cast<size_t>(m_Height) };
-	float* depthBuffer{ new float[pixelCount] };
-	std::fill_n(depthBuffer, pixelCount, FLT_MAX);
+	//Lock BackBuffer
+	SDL_LockSurface(m_FrameBuffer.GetSurface());
+
+	m_Triangles.clear();
+	m_TrianglePlanes.clear();
+	m_TriangleStats = {};
+	m_ShadingContext.cameraOrigin = m_Camera.origin;
+	m_ShadingContext.textureFilter = m_TextureFilter;
+	for (Tile& tile : m_Tiles)
+	{
+		tile.triangleIndices.clear();
+	}
 
-	// Clear screen
-	SDL_FillRect(m_pBackBuffer, nullptr, SDL_MapRGB(m_pBackBuffer->format, 100, 100, 100));
+	const Clipping::Frustum frustum{ Clipping::ExtractFrustum(m_Camera.viewMatrix * m_Camera.projectionMatrix) };
 
 	for (Mesh& mesh : m_SceneMeshes)
 	{
-		WorldToScreen(mesh);
+		if (Clipping::IsOutsideFrustum(frustum, mesh.bounds, mesh.GetWorldMatrix()))
+		{
+			++m_TriangleStats.meshesCulled;
+			continue;
+		}
+
+		const Material& material{ m_Materials[mesh.materialId] };
+		const size_t lodIndex{ SelectLod(mesh, mesh.GetWorldMatrix()) };
 
-		switch (mesh.primitiveTopology)
+		// Meshlets only cover the full detail mesh
+		if (lodIndex == 0 && !mesh.meshlets.empty())
 		{
-		case PrimitiveTopology::TriangleList:
-			for (size_t i{ 0 }; i < mesh.indices.size(); i += 3)
-			{
-				RenderScreenTri(
-					mesh.verticesOut[mesh.indices[i + 0]],
-					mesh.verticesOut[mesh.indices[i + 1]],
-					mesh.verticesOut[mesh.indices[i + 2]],
-					m_Materials[mesh.materialId],
-					depthBuffer
-				);
-			}
-			break;
+			RenderMeshlets(mesh, frustum, material);
+			continue;
+		}
 
-		case PrimitiveTopology::TriangleStrip:
-			bool clockwise{ true };
-			for (size_t i{ 0 }; i < mesh.indices.size() - 2; ++i)
-			{
-				Vertex_Out& v0{ mesh.verticesOut[mesh.indices[i + 0]] };
-				Vertex_Out& v1{ mesh.verticesOut[mesh.indices[i + 1]] };
-				Vertex_Out& v2{ mesh.verticesOut[mesh.indices[i + 2]] };
-
-				if (
-					v0.position == v1.position ||
-					v1.position == v2.position ||
-					v0.position == v2.position)
-				{
-					continue;
-				}
+		WorldToScreen(mesh);
 
-				if (clockwise)
-				{
-					RenderScreenTri(
-						v0, v1, v2, m_Materials[mesh.materialId],
-						depthBuffer
-					);
-				}
-				else
-				{
-					RenderScreenTri(
-						v2, v1, v0, m_Materials[mesh.materialId],
-						depthBuffer
-					);
-				}
+		const std::vector<uint32_t>& indices{ lodIndex == 0 ? mesh.indices : mesh.lods[lodIndex - 1].indices };
+		AssembleTriangles(GetTransformOutput(mesh), mesh.primitiveTopology, indices, material);
+	}
 
-				clockwise = !clockwise;
-			}
-			break;
-		}
+	for (InstancedMesh& instancedMesh : m_InstancedMeshes)
+	{
+		RenderInstances(instancedMesh, frustum);
 	}
 
-	delete[] depthBuffer;
+	// Every tile is owned by a single worker, so the frame buffer needs no locking
+	const TileRenderer renderTile{ SelectTileRenderer() };
+	m_ThreadPool.ParallelFor(m_Tiles.size(), [&](size_t tileIndex)
+		{
+			(this->*renderTile)(m_Tiles[tileIndex]);
+		});
 
 	//@END
 	//Update SDL Surface
-	SDL_UnlockSurface(m_pBackBuffer);
-	SDL_BlitSurface(m_pBackBuffer, nullptr, m_pFrontBuffer, nullptr);
+	SDL_UnlockSurface(m_FrameBuffer.GetSurface());
+	SDL_BlitSurface(m_FrameBuffer.GetSurface(), nullptr, m_pFrontBuffer, nullptr);
 	SDL_UpdateWindowSurface(m_pWindow);
 }
 
-void Renderer::WorldToScreen(Mesh& mesh) const
+void Renderer::WorldToScreen(Mesh& mesh)
+{
+	PrepareVertexBuffers(mesh);
+
+	// Resizing goes through Camera::CalculateProjectionMatrix, so the camera version covers the screen size as well
+	const bool isWorldStale{ mesh.transformedWorldVersion != mesh.GetWorldVersion() };
+	const bool isScreenStale{ isWorldStale || mesh.transformedCameraVersion != m_Camera.version };
+	if (!isScreenStale) return;
+
+	const TransformKernels::ScreenSetup setup{ GetScreenSetup() };
+	const Material& material{ m_Materials[mesh.materialId] };
+
+	const size_t vertexCount{ mesh.vertices.size() };
+	const size_t chunkCount{ (vertexCount + TRANSFORM_CHUNK_SIZE - 1) / TRANSFORM_CHUNK_SIZE };
+
+	const auto transformChunk{ [&](size_t chunkIndex)
+		{
+			const size_t begin{ chunkIndex * TRANSFORM_CHUNK_SIZE };
+			const size_t end{ std::min(begin + TRANSFORM_CHUNK_SIZE, vertexCount) };
+			TransformVertices(mesh, mesh.GetWorldMatrix(), mesh.worldPositions, GetTransformOutput(mesh), setup, begin, end, isWorldStale);
+			ShadeVertices(material, GetTransformOutput(mesh), begin, end);
+		} };
+
+	if (chunkCount > 1)
+	{
+		m_ThreadPool.ParallelFor(chunkCount, transformChunk);
+	}
+	else if (chunkCount == 1)
+	{
+		transformChunk(0);
+	}
+
+	mesh.transformedWorldVersion = mesh.GetWorldVersion();
+	mesh.transformedCameraVersion = m_Camera.version;
+}
+
+void Renderer::RenderMeshlets(Mesh& mesh, const Clipping::Frustum& frustum, const Material& material)
 {
+	PrepareVertexBuffers(mesh);
+
+	m_VisibleMeshlets.clear();
+	for (Meshlet& meshlet : mesh.meshlets)
+	{
+		if (Clipping::IsOutsideFrustum(frustum, meshlet.bounds, mesh.GetWorldMatrix()))
+		{
+			++m_TriangleStats.meshletsFrustumCulled;
+			continue;
+		}
+
+		if (IsMeshletFaceCulled(meshlet, mesh.GetWorldMatrix()))
+		{
+			++m_TriangleStats.meshletsBackfaceCulled;
+			continue;
+		}
+
+		m_VisibleMeshlets.push_back(&meshlet);
+	}
+
+	// Culled meshlets keep their stale versions, so they catch up once they come back into view
+	const TransformKernels::ScreenSetup setup{ GetScreenSetup() };
+	m_ThreadPool.ParallelFor(m_VisibleMeshlets.size(), [&](size_t visibleIndex)
+		{
+			Meshlet& meshlet{ *m_VisibleMeshlets[visibleIndex] };
+
+			const bool isWorldStale{ meshlet.transformedWorldVersion != mesh.GetWorldVersion() };
+			if (!isWorldStale && meshlet.transformedCameraVersion == m_Camera.version) return;
+
+			const size_t begin{ meshlet.vertexOffset };
+			const size_t end{ begin + meshlet.vertexCount };
+			TransformVertices(mesh, mesh.GetWorldMatrix(), mesh.worldPositions, GetTransformOutput(mesh), setup, begin, end, isWorldStale);
+			ShadeVertices(material, GetTransformOutput(mesh), begin, end);
+
+			meshlet.transformedWorldVersion = mesh.GetWorldVersion();
+			meshlet.transformedCameraVersion = m_Camera.version;
+		});
+
+	const TransformKernels::TransformOutput vertices{ GetTransformOutput(mesh) };
+	for (const Meshlet* pMeshlet : m_VisibleMeshlets)
+	{
+		const uint32_t indexEnd{ pMeshlet->indexOffset + pMeshlet->indexCount };
+		for (uint32_t i{ pMeshlet->indexOffset }; i < indexEnd; i += 3)
+		{
+			AssembleTriangle(vertices, mesh.indices[i + 0], mesh.indices[i + 1], mesh.indices[i + 2], material);
+		}
+	}
+}
+
+size_t Renderer::AddInstancedMesh(Mesh&& mesh, std::vector<MeshInstance> instances)
+{
+	m_InstancedMeshes.push_back(InstancedMesh{ std::move(mesh), std::move(instances) });
+	return m_InstancedMeshes.size() - 1;
+}
+
+void Renderer::RenderInstances(InstancedMesh& instancedMesh, const Clipping::Frustum& frustum)
+{
+	Mesh& mesh{ instancedMesh.mesh };
+	if (mesh.vertexStreams.Size() != mesh.vertices.size())
+	{
+		TransformKernels::BuildVertexStreams(mesh.vertices, mesh.vertexStreams);
+	}
+
+	m_VisibleInstances.clear();
+	for (const MeshInstance& instance : instancedMesh.instances)
+	{
+		if (Clipping::IsOutsideFrustum(frustum, mesh.bounds, instance.worldMatrix))
+		{
+			++m_TriangleStats.meshesCulled;
+			continue;
+		}
+
+		m_VisibleInstances.push_back({ &instance, SelectLod(mesh, instance.worldMatrix) });
+	}
+
+	const size_t vertexCount{ mesh.vertices.size() };
+	const size_t chunkCount{ (vertexCount + TRANSFORM_CHUNK_SIZE - 1) / TRANSFORM_CHUNK_SIZE };
+
+	m_InstanceVertices.resize(INSTANCE_GROUP_SIZE);
+	for (InstanceVertices& instanceVertices : m_InstanceVertices)
+	{
+		instanceVertices.worldPositions.Resize(vertexCount);
+		instanceVertices.vertices.resize(vertexCount);
+		instanceVertices.clipPositions.resize(vertexCount);
+		instanceVertices.clipFlags.resize(vertexCount);
+		instanceVertices.varyings.resize(vertexCount * VARYING_STRIDE);
+	}
+
+	const auto getOutput{ [](InstanceVertices& instanceVertices)
+		{
+			return TransformKernels::TransformOutput{
+				instanceVertices.vertices.data(),
+				instanceVertices.clipPositions.data(),
+				instanceVertices.clipFlags.data(),
+				instanceVertices.varyings.data()
+			};
+		} };
+
+	const Material& material{ m_Materials[mesh.materialId] };
+	const TransformKernels::ScreenSetup setup{ GetScreenSetup() };
+
+	// Binned triangles don't point back at their vertices, so a group's buffers are free again once it is assembled
+	for (size_t groupBegin{ 0 }; groupBegin < m_VisibleInstances.size(); groupBegin += INSTANCE_GROUP_SIZE)
+	{
+		const size_t groupSize{ std::min(INSTANCE_GROUP_SIZE, m_VisibleInstances.size() - groupBegin) };
+
+		// Every chunk of every instance is its own job, so a group spreads over all threads however small the mesh is
+		m_ThreadPool.ParallelFor(groupSize * chunkCount, [&](size_t jobIndex)
+			{
+				const MeshInstance& instance{ *m_VisibleInstances[groupBegin + jobIndex / chunkCount].pInstance };
+				InstanceVertices& instanceVertices{ m_InstanceVertices[jobIndex / chunkCount] };
+
+				const size_t begin{ jobIndex % chunkCount * TRANSFORM_CHUNK_SIZE };
+				const size_t end{ std::min(begin + TRANSFORM_CHUNK_SIZE, vertexCount) };
+				TransformVertices(mesh, instance.worldMatrix, instanceVertices.worldPositions, getOutput(instanceVertices), setup, begin, end, true);
+
+				// The tint is part of the vertex the shader sees
+				for (size_t i{ begin }; i < end; ++i)
+				{
+					instanceVertices.vertices[i].color *= instance.color;
+				}
+				ShadeVertices(material, getOutput(instanceVertices), begin, end);
+			});
+
+		for (size_t i{ 0 }; i < groupSize; ++i)
+		{
+			const size_t lodIndex{ m_VisibleInstances[groupBegin + i].lodIndex };
+			const std::vector<uint32_t>& indices{ lodIndex == 0 ? mesh.indices : mesh.lods[lodIndex - 1].indices };
+			AssembleTriangles(getOutput(m_InstanceVertices[i]), mesh.primitiveTopology, indices, material);
+		}
+	}
+}
+
+void Renderer::PrepareVertexBuffers(Mesh& mesh) const
+{
+	bool isReset{ false };
+
 	if (mesh.verticesOut.size() != mesh.vertices.size())
 	{
 		mesh.verticesOut.clear();
 		mesh.verticesOut.resize(mesh.vertices.size());
+		mesh.worldPositions.Resize(mesh.vertices.size());
+		mesh.clipPositions.resize(mesh.vertices.size());
+		mesh.clipFlags.resize(mesh.vertices.size());
+		mesh.varyingsOut.resize(mesh.vertices.size() * VARYING_STRIDE);
+		isReset = true;
 	}
 
-	const Matrix worldViewProjection{ mesh.worldMatrix * m_Camera.viewMatrix * m_Camera.projectionMatrix };
-
-	for (size_t i{ 0 }; i < mesh.vertices.size(); ++i)
+	if (mesh.vertexStreams.Size() != mesh.vertices.size())
 	{
-		// Mesh > World > View > Clipping
-		Vector4 transformed{ worldViewProjection.TransformPoint({ mesh.vertices[i].position, 1 }) };
+		TransformKernels::BuildVertexStreams(mesh.vertices, mesh.vertexStreams);
+		isReset = true;
+	}
 
-		// Perspective Divide
-		transformed.x /= transformed.w;
-		transformed.y /= transformed.w;
-		transformed.z /= transformed.w;
+	if (!isReset) return;
 
-		// Do Clipping > Image and insert back
-		const Vertex_Out out{
-			NdcToScreen(transformed),
-			mesh.vertices[i].color,
-			mesh.vertices[i].uv,
-			mesh.worldMatrix.TransformVector(mesh.vertices[i].normal).Normalized(),
-			mesh.worldMatrix.TransformVector(mesh.vertices[i].tangent).Normalized(),
-			(mesh.worldMatrix.TransformPoint(mesh.vertices[i].position) - m_Camera.origin).Normalized(),
-		};
+	mesh.transformedWorldVersion = UINT32_MAX;
+	for (Meshlet& meshlet : mesh.meshlets)
+	{
+		meshlet.transformedWorldVersion = UINT32_MAX;
+	}
+}
 
-		mesh.verticesOut[i] = out;
+TransformKernels::ScreenSetup Renderer::GetScreenSetup() const
+{
+	return {
+		m_Camera.viewMatrix * m_Camera.projectionMatrix,
+		static_cast<float>(m_Width),
+		static_cast<float>(m_Height),
+		m_GuardBandX,
+		m_GuardBandY
+	};
+}
+
+void Renderer::TransformVertices(const Mesh& mesh, const Matrix& world, PositionStreams& worldPositions, const TransformKernels::TransformOutput& output,
+	const TransformKernels::ScreenSetup& setup, size_t begin, size_t end, bool isWorldStale) const
+{
+	if (isWorldStale)
+	{
+		m_TransformKernels.toWorld(world, mesh.vertexStreams, mesh.vertices.data(), begin, end, worldPositions, output.pVertices);
 	}
+
+	m_TransformKernels.toScreen(setup, worldPositions, begin, end, output);
+}
+
+void Renderer::ShadeVertices(const Material& material, const TransformKernels::TransformOutput& output, size_t begin, size_t end) const
+{
+	SceneShaders::Visit(material.shaderId, [&]<typename Shader>(std::type_identity<Shader>)
+		{
+			for (size_t i{ begin }; i < end; ++i)
+			{
+				const VaryingArray<Shader> varyings{ std::bit_cast<VaryingArray<Shader>>(Shader::ShadeVertex(output.pVertices[i], m_ShadingContext)) };
+				std::copy(varyings.begin(), varyings.end(), output.pVaryings + i * VARYING_STRIDE);
+			}
+		});
 }
 
 Vector4 Renderer::NdcToScreen(Vector4 ndc) const
@@ -213,220 +473,698 @@ void Renderer::CycleNormalMode()
 	m_UsingNormalMap = !m_UsingNormalMap;
 }
 
-void Renderer::RenderScreenTri(const Vertex_Out& v0, const Vertex_Out& v1, const Vertex_Out& v2, const Material& mat, float* depthBuffer) const
+void Renderer::CycleCullMode()
 {
-	if (!GeometryUtils::CheckRange(v0.position.x, v0.position.y, v0.position.z, m_Width, m_Height, 1) ||
-		!GeometryUtils::CheckRange(v1.position.x, v1.position.y, v1.position.z, m_Width, m_Height, 1) || 
-		!GeometryUtils::CheckRange(v2.position.x, v2.position.y, v2.position.z, m_Width, m_Height, 1))
+	m_CullMode = static_cast<CullMode>((static_cast<int>(m_CullMode) + 1) % (static_cast<int>(CullMode::front) + 1));
+}
+
+void Renderer::ToggleVisibilityBuffer()
+{
+	m_UsingVisibilityBuffer = !m_UsingVisibilityBuffer;
+}
+
+void Renderer::CycleTextureFilter()
+{
+	m_TextureFilter = static_cast<TextureFilter>((static_cast<int>(m_TextureFilter) + 1) % (static_cast<int>(TextureFilter::trilinear) + 1));
+}
+
+void Renderer::Resize(int width, int height)
+{
+	m_Width = width;
+	m_Height = height;
+
+	// The window surface is recreated by SDL whenever the window changes size
+	m_pFrontBuffer = SDL_GetWindowSurface(m_pWindow);
+	m_FrameBuffer.Resize(width, height);
+	m_ClearColor = SDL_MapRGB(m_FrameBuffer.GetSurface()->format, 100, 100, 100);
+
+	InitializeTiles();
+
+	m_GuardBandX = 1.f + 2.f * static_cast<float>(Clipping::GUARD_BAND_SIZE) / static_cast<float>(width);
+	m_GuardBandY = 1.f + 2.f * static_cast<float>(Clipping::GUARD_BAND_SIZE) / static_cast<float>(height);
+
+	m_Camera.aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+	m_Camera.CalculateProjectionMatrix();
+}
+
+void Renderer::InitializeTiles()
+{
+	const int tileCountX{ (m_Width + TILE_SIZE - 1) / TILE_SIZE };
+	const int tileCountY{ (m_Height + TILE_SIZE - 1) / TILE_SIZE };
+
+	m_Tiles.clear();
+	m_Tiles.resize(static_cast<size_t>(tileCountX) * static_cast<size_t>(tileCountY));
+
+	for (int ty{ 0 }; ty < tileCountY; ++ty)
 	{
+		for (int tx{ 0 }; tx < tileCountX; ++tx)
+		{
+			m_Tiles[tx + ty * tileCountX].bound = {
+				{ tx * TILE_SIZE, ty * TILE_SIZE },
+				{ std::min((tx + 1) * TILE_SIZE, m_Width), std::min((ty + 1) * TILE_SIZE, m_Height) }
+			};
+		}
+	}
+}
+
+void Renderer::AssembleTriangles(const TransformKernels::TransformOutput& vertices, PrimitiveTopology topology, const std::vector<uint32_t>& indices, const Material& mat)
+{
+	switch (topology)
+	{
+	case PrimitiveTopology::TriangleList:
+		for (size_t i{ 0 }; i < indices.size(); i += 3)
+		{
+			AssembleTriangle(vertices, indices[i + 0], indices[i + 1], indices[i + 2], mat);
+		}
+		break;
+
+	case PrimitiveTopology::TriangleStrip:
+		bool clockwise{ true };
+		for (size_t i{ 0 }; i < indices.size() - 2; ++i)
+		{
+			const uint32_t i0{ indices[i + 0] };
+			const uint32_t i1{ indices[i + 1] };
+			const uint32_t i2{ indices[i + 2] };
+
+			if (
+				vertices.pClipPositions[i0] == vertices.pClipPositions[i1] ||
+				vertices.pClipPositions[i1] == vertices.pClipPositions[i2] ||
+				vertices.pClipPositions[i0] == vertices.pClipPositions[i2])
+			{
+				continue;
+			}
+
+			if (clockwise)
+			{
+				AssembleTriangle(vertices, i0, i1, i2, mat);
+			}
+			else
+			{
+				AssembleTriangle(vertices, i2, i1, i0, mat);
+			}
+
+			clockwise = !clockwise;
+		}
+		break;
+	}
+}
+
+void Renderer::AssembleTriangle(const TransformKernels::TransformOutput& vertices, uint32_t i0, uint32_t i1, uint32_t i2, const Material& mat)
+{
+	const uint8_t flags0{ vertices.pClipFlags[i0] };
+	const uint8_t flags1{ vertices.pClipFlags[i1] };
+	const uint8_t flags2{ vertices.pClipFlags[i2] };
+
+	++m_TriangleStats.submitted;
+
+	// All vertices outside the same frustum plane
+	if ((flags0 & flags1 & flags2 & Clipping::CLIP_FRUSTUM) != Clipping::CLIP_NONE)
+	{
+		++m_TriangleStats.frustumCulled;
 		return;
 	}
 
+	// Only triangles crossing the near or far plane or leaving the guard band pay for clipping,
+	// everything else is clipped to the viewport by the rasterizer's bounding box
+	const uint8_t combinedFlags{ static_cast<uint8_t>(flags0 | flags1 | flags2) };
+	if ((combinedFlags & Clipping::CLIP_MUST_CLIP) != Clipping::CLIP_NONE)
+	{
+		ClipAndBinTriangle(vertices, i0, i1, i2, combinedFlags, mat);
+		return;
+	}
+
+	BinScreenTri(
+		{ vertices.pVertices[i0].position, vertices.pVaryings + i0 * VARYING_STRIDE },
+		{ vertices.pVertices[i1].position, vertices.pVaryings + i1 * VARYING_STRIDE },
+		{ vertices.pVertices[i2].position, vertices.pVaryings + i2 * VARYING_STRIDE },
+		mat
+	);
+}
+
+void Renderer::ClipAndBinTriangle(const TransformKernels::TransformOutput& vertices, uint32_t i0, uint32_t i1, uint32_t i2, uint8_t clipFlags, const Material& mat)
+{
+	const auto toClipVertex{ [&](uint32_t index)
+		{
+			Clipping::ClipVertex clipVertex{ vertices.pClipPositions[index] };
+			std::copy_n(vertices.pVaryings + index * VARYING_STRIDE, VARYING_STRIDE, clipVertex.varyings.begin());
+			return clipVertex;
+		} };
+
+	const Clipping::ClipVertex triangle[3]{ toClipVertex(i0), toClipVertex(i1), toClipVertex(i2) };
+
+	Clipping::ClipVertex polygon[Clipping::MAX_POLYGON_VERTICES]{};
+	const int vertexCount{ Clipping::ClipPolygon(triangle, 3, clipFlags, m_GuardBandX, m_GuardBandY, polygon) };
+	if (vertexCount < 3)
+	{
+		++m_TriangleStats.frustumCulled;
+		return;
+	}
+
+	ScreenVertex screenVertices[Clipping::MAX_POLYGON_VERTICES]{};
+	for (int i{ 0 }; i < vertexCount; ++i)
+	{
+		const Vector4& clipPos{ polygon[i].position };
+
+		screenVertices[i] = {
+			NdcToScreen({ clipPos.x / clipPos.w, clipPos.y / clipPos.w, clipPos.z / clipPos.w, clipPos.w }),
+			polygon[i].varyings.data()
+		};
+	}
+
+	// Clipping keeps the polygon convex and its winding intact, so a fan covers it
+	for (int i{ 1 }; i < vertexCount - 1; ++i)
+	{
+		BinScreenTri(screenVertices[0], screenVertices[i], screenVertices[i + 1], mat);
+	}
+}
+
+bool Renderer::IsMeshletFaceCulled(const Meshlet& meshlet, const Matrix& world) const
+{
+	if (m_CullMode == CullMode::none || meshlet.coneCutoff > 1.f) return false;
+
+	const Vector3 center{ world.TransformPoint(meshlet.bounds.center) };
+	const float radius{ meshlet.bounds.radius * GetMaxScale(world) };
+
+	// Culling front faces is the same test with every normal flipped
+	Vector3 coneAxis{ world.TransformVector(meshlet.coneAxis).Normalized() };
+	if (m_CullMode == CullMode::front) coneAxis = -coneAxis;
+
+	// Every face points away from the camera when the whole bounding sphere is seen from behind all of them
+	const Vector3 toCenter{ center - m_Camera.origin };
+	return Vector3::Dot(toCenter, coneAxis) >= meshlet.coneCutoff * toCenter.Magnitude() + radius;
+}
+
+size_t Renderer::SelectLod(const Mesh& mesh, const Matrix& world) const
+{
+	if (mesh.lods.empty()) return 0;
+
+	const Vector3 center{ world.TransformPoint(mesh.bounds.center) };
+	const float radius{ mesh.bounds.radius * GetMaxScale(world) };
+	const float distance{ (center - m_Camera.origin).Magnitude() };
+	if (distance <= radius) return 0;
+
+	// Radius of the bounding sphere on screen, in pixels
+	const float projectedRadius{ radius / (distance * m_Camera.fov) * static_cast<float>(m_Height) * 0.5f };
+
+	// LOD errors scale with the mesh, so relative to its radius they project the same way
+	size_t lodIndex{ 0 };
+	while (lodIndex < mesh.lods.size() && mesh.lods[lodIndex].error / mesh.bounds.radius * projectedRadius <= LOD_PIXEL_ERROR)
+	{
+		++lodIndex;
+	}
+	return lodIndex;
+}
+
+bool Renderer::IsFaceCulled(int64_t signedDoubleArea) const
+{
+	// ParseOBJ's flipAxisAndWinding leaves front faces running clockwise on screen, which gives them a negative area
+	const bool frontFacing{ signedDoubleArea < 0 };
+
+	switch (m_CullMode)
+	{
+	case CullMode::back:
+		return !frontFacing;
+	case CullMode::front:
+		return frontFacing;
+	default:
+		return false;
+	}
+}
+
+void Renderer::BinScreenTri(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, const Material& mat)
+{
+	const Vector2i p0{ GeometryUtils::SnapToSubpixel(v0.position) };
+	const Vector2i p1{ GeometryUtils::SnapToSubpixel(v1.position) };
+	const Vector2i p2{ GeometryUtils::SnapToSubpixel(v2.position) };
+
+	const int64_t doubleArea{ GeometryUtils::SignedDoubleArea(p0, p1, p2) };
+	if (doubleArea == 0)
+	{
+		++m_TriangleStats.degenerateCulled;
+		return;
+	}
 
-	const GeometryUtils::ScreenBoundingBox bound{ GeometryUtils::GetScreenBoundingBox(
-		v0.position, v1.position, v2.position,
-		m_Width, m_Height
-	) };
-	for (int px{ bound.topLeft.x }; px < bound.bottomRight.x; ++px)
+	if (IsFaceCulled(doubleArea))
 	{
-		for (int py{ bound.topLeft.y }; py < bound.bottomRight.y; ++py)
+		++m_TriangleStats.backfaceCulled;
+		return;
+	}
+
+	const GeometryUtils::ScreenBoundingBox bound{ GeometryUtils::GetScreenBoundingBox(p0, p1, p2, m_Width, m_Height) };
+	if (bound.topLeft.x >= bound.bottomRight.x || bound.topLeft.y >= bound.bottomRight.y)
+	{
+		++m_TriangleStats.noCoverageCulled;
+		return;
+	}
+
+	const GeometryUtils::TriangleEdges edges{ GeometryUtils::SetupTriangleEdges(p0, p1, p2) };
+
+	// Tiny triangles often have a single candidate pixel, test it right away instead of binning them
+	if (bound.bottomRight.x - bound.topLeft.x == 1 && bound.bottomRight.y - bound.topLeft.y == 1)
+	{
+		const int px{ bound.topLeft.x };
+		const int py{ bound.topLeft.y };
+		if (edges.e0.Evaluate(px, py) < 0 || edges.e1.Evaluate(px, py) < 0 || edges.e2.Evaluate(px, py) < 0)
+		{
+			++m_TriangleStats.noCoverageCulled;
+			return;
+		}
+	}
+
+	++m_TriangleStats.rasterized;
+
+	const uint32_t triangleIndex{ static_cast<uint32_t>(m_Triangles.size()) };
+	const float minDepth{ std::min(v0.position.w, std::min(v1.position.w, v2.position.w)) };
+	m_Triangles.push_back(RasterTriangle{
+		&mat,
+		edges,
+		bound,
+		1.f / v0.position.w,
+		1.f / v1.position.w,
+		1.f / v2.position.w,
+		minDepth
+	});
+	m_TrianglePlanes.push_back(SceneShaders::Visit(mat.shaderId, [&]<typename Shader>(std::type_identity<Shader>)
 		{
-			const Vector2 screenPos{ static_cast<float>(px) + 0.5f, static_cast<float>(py) + 0.5f };
-			ColorRGB finalColor{ -1, -1, -1 };
+			return SetupAttributePlanes<Shader>(edges, bound.topLeft, v0, v1, v2, UsedVaryingCount<Shader>(m_UsingNormalMap));
+		}));
 
-			const GeometryUtils::TriResult res{
-			GeometryUtils::HitTest_ScreenTriangle(
-				screenPos, v0, v1, v2
-			) };
+	// Triangles are appended in submission order, which keeps each tile's depth test results deterministic
+	const int tileCountX{ (m_Width + TILE_SIZE - 1) / TILE_SIZE };
+	for (int ty{ bound.topLeft.y / TILE_SIZE }; ty <= (bound.bottomRight.y - 1) / TILE_SIZE; ++ty)
+	{
+		for (int tx{ bound.topLeft.x / TILE_SIZE }; tx <= (bound.bottomRight.x - 1) / TILE_SIZE; ++tx)
+		{
+			m_Tiles[tx + ty * tileCountX].triangleIndices.push_back(triangleIndex);
+		}
+	}
+}
 
-			if (res.hit)
-			{
-				const int pixelIndex{ px + py * m_Width };
-
-				// position.z holds projected depth for all vertices
-				// position.w holds view depth for all vertices
-				const float viewDepth{
-					1.f / 
-					(
-						(1.f / v0.position.w * res.w0) +
-						(1.f / v1.position.w * res.w1) +
-						(1.f / v2.position.w * res.w2)
-					)
-				};
+Renderer::TileRenderer Renderer::SelectTileRenderer() const
+{
+	// Depth only needs the depth buffer, the shading settings don't change anything there
+	if (m_RenderMode == RenderMode::depth)
+	{
+		if (m_UsingVisibilityBuffer) return &Renderer::RenderTile<PipelineState<RenderMode::depth, ShadingMode::combined, false, true>>;
+		return &Renderer::RenderTile<PipelineState<RenderMode::depth, ShadingMode::combined, false, false>>;
+	}
 
-				const float projectedDepth{
-					1.f /
-					(
-						(1.f / v0.position.z * res.w0) +
-						(1.f / v1.position.z * res.w1) +
-						(1.f / v2.position.z * res.w2)
-					)
-				};
+	switch (m_ShadingMode)
+	{
+	case ShadingMode::observedArea:
+		return SelectTileRenderer<ShadingMode::observedArea>();
+	case ShadingMode::diffuse:
+		return SelectTileRenderer<ShadingMode::diffuse>();
+	case ShadingMode::specular:
+		return SelectTileRenderer<ShadingMode::specular>();
+	default:
+		return SelectTileRenderer<ShadingMode::combined>();
+	}
+}
+
+template<Renderer::ShadingMode Shading>
+Renderer::TileRenderer Renderer::SelectTileRenderer() const
+{
+	if (m_UsingNormalMap)
+	{
+		if (m_UsingVisibilityBuffer) return &Renderer::RenderTile<PipelineState<RenderMode::standard, Shading, true, true>>;
+		return &Renderer::RenderTile<PipelineState<RenderMode::standard, Shading, true, false>>;
+	}
+
+	if (m_UsingVisibilityBuffer) return &Renderer::RenderTile<PipelineState<RenderMode::standard, Shading, false, true>>;
+	return &Renderer::RenderTile<PipelineState<RenderMode::standard, Shading, false, false>>;
+}
+
+template<typename State>
+void Renderer::RenderTile(Tile& tile) const
+{
+	if (tile.triangleIndices.empty())
+	{
+		// Nothing gets drawn here, so the tile only needs clearing if last frame drew to it.
+		// Its memory won't be touched again until the blit, which is what streaming stores are for.
+		if (!tile.isClear)
+		{
+			m_FrameBuffer.ClearTile(tile.bound, m_ClearColor, true);
+			tile.isClear = true;
+		}
+		return;
+	}
+
+	// Cleared right before drawing so the tile is still in cache for the rasterizer
+	m_FrameBuffer.ClearTile(tile.bound, m_ClearColor, false);
+	tile.isClear = false;
+
+	const float* blockMaxDepth{ m_FrameBuffer.GetBlockMaxDepth() };
+	const int blockStride{ m_FrameBuffer.GetBlockStride() };
+
+	// Tiles are aligned to blocks, so every block belongs to exactly one tile
+	const int firstBlockX{ tile.bound.topLeft.x / BLOCK_SIZE };
+	const int firstBlockY{ tile.bound.topLeft.y / BLOCK_SIZE };
+	const int endBlockX{ (tile.bound.bottomRight.x + BLOCK_SIZE - 1) / BLOCK_SIZE };
+	const int endBlockY{ (tile.bound.bottomRight.y + BLOCK_SIZE - 1) / BLOCK_SIZE };
 
+	float tileMaxDepth{ FLT_MAX };
 
-				// Depth test
-				if (depthBuffer[pixelIndex] < viewDepth) continue;
+	for (const uint32_t triangleIndex : tile.triangleIndices)
+	{
+		// Whole triangle behind everything already drawn in this tile
+		if (m_Triangles[triangleIndex].minDepth > tileMaxDepth) continue;
+
+		if (!RenderScreenTri<State>(triangleIndex, tile.bound)) continue;
+
+		tileMaxDepth = 0.f;
+		for (int blockY{ firstBlockY }; blockY < endBlockY; ++blockY)
+		{
+			const float* pRow{ blockMaxDepth + blockY * blockStride };
+			tileMaxDepth = std::max(tileMaxDepth, *std::max_element(pRow + firstBlockX, pRow + endBlockX));
+		}
+	}
+
+	// Resolving right after rasterizing keeps the tile's depth and IDs in cache
+	if constexpr (State::usingVisibilityBuffer)
+	{
+		ResolveTile<State>(tile);
+	}
+}
+
+template<typename State>
+bool Renderer::RenderScreenTri(uint32_t triangleIndex, const GeometryUtils::ScreenBoundingBox& tileBound) const
+{
+	const RasterTriangle& tri{ m_Triangles[triangleIndex] };
 
-				depthBuffer[pixelIndex] = viewDepth;
+	float* depthBuffer{ m_FrameBuffer.GetDepth() };
+	uint32_t* visibilityBuffer{ m_FrameBuffer.GetVisibility() };
+	float* blockMaxDepth{ m_FrameBuffer.GetBlockMaxDepth() };
+	const int stride{ m_FrameBuffer.GetStride() };
+	const GeometryUtils::TriangleEdges& edges{ tri.edges };
+
+	const GeometryUtils::ScreenBoundingBox bound{
+		{ std::max(tri.bound.topLeft.x, tileBound.topLeft.x), std::max(tri.bound.topLeft.y, tileBound.topLeft.y) },
+		{ std::min(tri.bound.bottomRight.x, tileBound.bottomRight.x), std::min(tri.bound.bottomRight.y, tileBound.bottomRight.y) }
+	};
+
+	RasterKernels::SpanSetup span{};
+	span.stepE0 = static_cast<float>(edges.e0.a);
+	span.stepE1 = static_cast<float>(edges.e1.a);
+	span.stepE2 = static_cast<float>(edges.e2.a);
+	span.invArea = edges.invArea;
+	span.invW0 = tri.invW0;
+	span.invW1 = tri.invW1;
+	span.invW2 = tri.invW2;
+
+	RasterKernels::SpanFragments fragments{};
+
+	// 1/w is linear in screen space, so over a block its largest value (nearest depth) is found at a corner
+	const float invWStepX{ (span.stepE0 * span.invW0 + span.stepE1 * span.invW1 + span.stepE2 * span.invW2) * edges.invArea };
+	const float invWStepY{ (
+		static_cast<float>(edges.e0.b) * span.invW0 +
+		static_cast<float>(edges.e1.b) * span.invW1 +
+		static_cast<float>(edges.e2.b) * span.invW2
+	) * edges.invArea };
+
+	// The block depth below is evaluated in a different order than the kernels' per pixel depth, so it can come out
+	// a few ulps off. Blocks are only rejected past this relative margin, which keeps the test conservative.
+	constexpr float blockDepthTolerance{ 1e-5f };
+
+	bool isDepthWritten{ false };
+
+	// Walk the box in BLOCK_SIZE blocks aligned to the tile, and classify each block against the edges before touching pixels
+	const int firstBlockX{ bound.topLeft.x - (bound.topLeft.x - tileBound.topLeft.x) % BLOCK_SIZE };
+	const int firstBlockY{ bound.topLeft.y - (bound.topLeft.y - tileBound.topLeft.y) % BLOCK_SIZE };
+
+	for (int blockY{ firstBlockY }; blockY < bound.bottomRight.y; blockY += BLOCK_SIZE)
+	{
+		const int y0{ std::max(blockY, bound.topLeft.y) };
+		const int y1{ std::min(blockY + BLOCK_SIZE, bound.bottomRight.y) };
+
+		for (int blockX{ firstBlockX }; blockX < bound.bottomRight.x; blockX += BLOCK_SIZE)
+		{
+			const int x0{ std::max(blockX, bound.topLeft.x) };
+			const int x1{ std::min(blockX + BLOCK_SIZE, bound.bottomRight.x) };
 
-				if (m_RenderMode == RenderMode::depth)
+			const int64_t blockWidth{ x1 - x0 - 1 };
+			const int64_t blockHeight{ y1 - y0 - 1 };
+
+			const GeometryUtils::EdgeFunction* edgeFunctions[3]{ &edges.e0, &edges.e1, &edges.e2 };
+			int64_t corners[3]{};
+			bool isEdgeInside[3]{};
+
+			bool isOutside{ false };
+			for (int i{ 0 }; i < 3; ++i)
+			{
+				// Edge functions are linear, so their extremes over the block are found at its corner pixels
+				const GeometryUtils::EdgeFunction& edge{ *edgeFunctions[i] };
+				corners[i] = edge.Evaluate(x0, y0);
+
+				const int64_t stepX{ edge.a * blockWidth };
+				const int64_t stepY{ edge.b * blockHeight };
+				const int64_t minValue{ corners[i] + std::min(stepX, int64_t{}) + std::min(stepY, int64_t{}) };
+				const int64_t maxValue{ corners[i] + std::max(stepX, int64_t{}) + std::max(stepY, int64_t{}) };
+
+				isOutside |= maxValue < 0;
+				isEdgeInside[i] = minValue >= 0;
+			}
+			if (isOutside) continue;
+
+			const float cornerInvW{ (
+				static_cast<float>(corners[0]) * span.invW0 +
+				static_cast<float>(corners[1]) * span.invW1 +
+				static_cast<float>(corners[2]) * span.invW2
+			) * edges.invArea };
+			const float maxInvW{
+				cornerInvW +
+				std::max(invWStepX * static_cast<float>(blockWidth), 0.f) +
+				std::max(invWStepY * static_cast<float>(blockHeight), 0.f)
+			};
+			const float blockMinDepth{ maxInvW > 0.f ? std::max(1.f / maxInvW, tri.minDepth) : tri.minDepth };
+
+			// Block behind everything already drawn in it
+			float& storedMaxDepth{ blockMaxDepth[blockX / BLOCK_SIZE + blockY / BLOCK_SIZE * m_FrameBuffer.GetBlockStride()] };
+			if (blockMinDepth > storedMaxDepth * (1.f + blockDepthTolerance)) continue;
+
+			// Fully covered blocks only need the depth test
+			const bool isInside{ isEdgeInside[0] && isEdgeInside[1] && isEdgeInside[2] };
+			const RasterKernels::SpanKernel kernel{ isInside ? m_SpanKernels.depth : m_SpanKernels.coverageDepth };
+
+			// Edges this block lies fully inside of always pass. The others straddle the block,
+			// so their values stay within a few block steps of zero and fit the kernels' 32-bit lanes.
+			span.coverageStep0 = isEdgeInside[0] ? 0 : static_cast<int32_t>(edges.e0.a);
+			span.coverageStep1 = isEdgeInside[1] ? 0 : static_cast<int32_t>(edges.e1.a);
+			span.coverageStep2 = isEdgeInside[2] ? 0 : static_cast<int32_t>(edges.e2.a);
+
+			int64_t rowE0{ corners[0] };
+			int64_t rowE1{ corners[1] };
+			int64_t rowE2{ corners[2] };
+			uint32_t writtenMask{ 0 };
+
+			for (int py{ y0 }; py < y1; ++py)
+			{
+				span.coverage0 = isEdgeInside[0] ? 0 : static_cast<int32_t>(rowE0);
+				span.coverage1 = isEdgeInside[1] ? 0 : static_cast<int32_t>(rowE1);
+				span.coverage2 = isEdgeInside[2] ? 0 : static_cast<int32_t>(rowE2);
+
+				span.e0 = static_cast<float>(rowE0);
+				span.e1 = static_cast<float>(rowE1);
+				span.e2 = static_cast<float>(rowE2);
+
+				uint32_t mask{ kernel(span, x1 - x0, depthBuffer + py * stride + x0, fragments) };
+				writtenMask |= mask;
+				if constexpr (State::usingVisibilityBuffer)
 				{
-					const float remapMin{ 0.995f };
-					const float remapMax{ 1.0f };
-					const float depthColor{ (Clamp(projectedDepth, remapMin, remapMax) - remapMin) / (remapMax - remapMin) };
-					finalColor = ColorRGB{ depthColor,depthColor,depthColor };
+					uint32_t* pIds{ visibilityBuffer + py * stride + x0 };
+					while (mask != 0)
+					{
+						const int lane{ std::countr_zero(mask) };
+						mask &= mask - 1;
+
+						pIds[lane] = triangleIndex;
+					}
 				}
-				else
+				else if (mask != 0)
 				{
-#pragma region Interpolation
-					const Vector4 interpolatedPosition{
-						static_cast<float>(px),
-						static_cast<float>(py),
-						projectedDepth,
-						viewDepth
-					};
-
-					const ColorRGB interpolatedColor{
-						(
-							(v0.color / v0.position.w * res.w0) +
-							(v1.color / v1.position.w * res.w1) +
-							(v2.color / v2.position.w * res.w2)
-						) * viewDepth
-					};
-
-					const Vector2 interpolatedUV{
-						(
-							(v0.uv / v0.position.w * res.w0) +
-							(v1.uv / v1.position.w * res.w1) +
-							(v2.uv / v2.position.w * res.w2)
-						) * viewDepth
-					};
-					const Vector3 interpolatedNormal{
-						(
-							(v0.normal / v0.position.w * res.w0) +
-							(v1.normal / v1.position.w * res.w1) +
-							(v2.normal / v2.position.w * res.w2)
-						) * viewDepth
-					};
-					const Vector3 interpolatedTangent{
-						(
-							(v0.tangent / v0.position.w * res.w0) +
-							(v1.tangent / v1.position.w * res.w1) +
-							(v2.tangent / v2.position.w * res.w2)
-						) * viewDepth
-					};
-					const Vector3 interpolatedViewDirection{
-						(
-							(v0.viewDirection / v0.position.w * res.w0) +
-							(v1.viewDirection / v1.position.w * res.w1) +
-							(v2.viewDirection / v2.position.w * res.w2)
-						) * viewDepth
-					};
-
-#pragma endregion
-					Vertex_Out interpolatedVertex{
-						interpolatedPosition,
-						interpolatedColor,
-						interpolatedUV,
-						interpolatedNormal.Normalized(),
-						interpolatedTangent.Normalized(),
-						interpolatedViewDirection.Normalized()
-					};
-
-					finalColor = Shade(interpolatedVertex, mat);
+					RasterKernels::ColorSpan colors{};
+					const uint32_t shadedMask{ mask };
+					while (mask != 0)
+					{
+						const int lane{ std::countr_zero(mask) };
+						mask &= mask - 1;
+
+						const ColorRGB color{ ShadePixel<State>(x0 + lane, py, fragments.viewDepth[lane], triangleIndex) };
+						colors.r[lane] = color.r;
+						colors.g[lane] = color.g;
+						colors.b[lane] = color.b;
+					}
+
+					m_FrameBuffer.WriteColorSpan(x0, py, colors, shadedMask);
 				}
 
-				//Update Color in Buffer
-				finalColor.MaxToOne();
+				rowE0 += edges.e0.b;
+				rowE1 += edges.e1.b;
+				rowE2 += edges.e2.b;
+			}
 
-				m_pBackBufferPixels[pixelIndex] = SDL_MapRGB(m_pBackBuffer->format,
-					static_cast<uint8_t>(finalColor.r * 255),
-					static_cast<uint8_t>(finalColor.g * 255),
-					static_cast<uint8_t>(finalColor.b * 255)
-				);
+			if (writtenMask != 0)
+			{
+				storedMaxDepth = GetBlockMaxDepth(blockX, blockY);
+				isDepthWritten = true;
 			}
 		}
 	}
+
+	return isDepthWritten;
 }
 
-size_t Renderer::AddMaterial(const std::string& diffuse, const std::string& normal, const std::string& specular,
-	const std::string& gloss)
+float Renderer::GetBlockMaxDepth(int blockX, int blockY) const
 {
-	Texture* diffuseTexture{ nullptr };
-	if (!diffuse.empty()) diffuseTexture = Texture::LoadFromFile(diffuse);
+	const float* depthBuffer{ m_FrameBuffer.GetDepth() };
 
-	Texture* normalTexture{ nullptr };
-	if (!normal.empty()) normalTexture = Texture::LoadFromFile(normal);
+	const int endX{ std::min(blockX + BLOCK_SIZE, m_Width) };
+	const int endY{ std::min(blockY + BLOCK_SIZE, m_Height) };
 
-	Texture* specularTexture{ nullptr };
-	if (!specular.empty()) specularTexture = Texture::LoadFromFile(specular);
+	float maxDepth{ 0.f };
+	for (int py{ blockY }; py < endY; ++py)
+	{
+		const float* pRow{ depthBuffer + py * m_FrameBuffer.GetStride() };
+		maxDepth = std::max(maxDepth, *std::max_element(pRow + blockX, pRow + endX));
+	}
+	return maxDepth;
+}
 
-	Texture* glossTexture{ nullptr };
-	if (!gloss.empty()) glossTexture = Texture::LoadFromFile(gloss);
+template<typename State>
+void Renderer::ResolveTile(const Tile& tile) const
+{
+	const float* depthBuffer{ m_FrameBuffer.GetDepth() };
+	const uint32_t* visibilityBuffer{ m_FrameBuffer.GetVisibility() };
+	const int stride{ m_FrameBuffer.GetStride() };
 
+	for (int py{ tile.bound.topLeft.y }; py < tile.bound.bottomRight.y; ++py)
+	{
+		for (int spanX{ tile.bound.topLeft.x }; spanX < tile.bound.bottomRight.x; spanX += RasterKernels::SPAN_WIDTH)
+		{
+			const int count{ std::min(RasterKernels::SPAN_WIDTH, tile.bound.bottomRight.x - spanX) };
 
-	m_Materials.push_back(Material{ diffuseTexture, normalTexture, specularTexture, glossTexture });
-	return m_Materials.size() - 1;
-}
+			RasterKernels::ColorSpan colors{};
+			uint32_t mask{ 0 };
+			for (int lane{ 0 }; lane < count; ++lane)
+			{
+				const int pixelIndex{ spanX + lane + py * stride };
+				const uint32_t triangleIndex{ visibilityBuffer[pixelIndex] };
+				if (triangleIndex == FrameBuffer::INVALID_TRIANGLE) continue;
+
+				// The depth buffer already holds the view depth, everything else comes from the triangle's planes
+				const ColorRGB color{ ShadePixel<State>(spanX + lane, py, depthBuffer[pixelIndex], triangleIndex) };
+				colors.r[lane] = color.r;
+				colors.g[lane] = color.g;
+				colors.b[lane] = color.b;
+				mask |= 1u << lane;
+			}
 
+			if (mask != 0) m_FrameBuffer.WriteColorSpan(spanX, py, colors, mask);
+		}
+	}
+}
 
-ColorRGB Renderer::Shade(const Vertex_Out& vertex, const Material& material) const
+template<typename Shader>
+Renderer::AttributePlanes Renderer::SetupAttributePlanes(const GeometryUtils::TriangleEdges& edges, const Vector2i& origin, const ScreenVertex& v0, const ScreenVertex& v1,
+	const ScreenVertex& v2, size_t varyingCount)
 {
-	const Vector3 lightDirection{ .577f, -.577f, .577f };
+	const GeometryUtils::BarycentricPlanes barycentric{ GeometryUtils::SetupBarycentricPlanes(edges, origin) };
 
-	// Normal
-	const Vector3 binormal{ Vector3::Cross(vertex.normal, vertex.tangent) };
-	const Matrix tangentSpaceAxis{ vertex.tangent, binormal, vertex.normal, Vector3::Zero };
+	const float invW0{ 1.f / v0.position.w };
+	const float invW1{ 1.f / v1.position.w };
+	const float invW2{ 1.f / v2.position.w };
 
-	const ColorRGB normalMapSample{ material.pNormal->Sample(vertex.uv) };
-	Vector3 normal{ normalMapSample.ToVector3() * 2.f - Vector3::One };
-	normal = tangentSpaceAxis.TransformPoint(normal);
-	normal.Normalize();
+	AttributePlanes planes{};
+	planes.origin = origin;
 
-	if (!m_UsingNormalMap) normal = vertex.normal;
+	// position.z holds projected depth for all vertices
+	planes.invDepth = barycentric.Interpolate(1.f / v0.position.z, 1.f / v1.position.z, 1.f / v2.position.z);
+	planes.invW = barycentric.Interpolate(invW0, invW1, invW2);
 
-	const float observedArea{ Vector3::Dot(normal, -lightDirection) };
-	if (observedArea <= 0)
+	for (size_t i{ 0 }; i < varyingCount; ++i)
 	{
-		return colors::Black;
+		planes.varyings[i] = barycentric.Interpolate(v0.pVaryings[i] * invW0, v1.pVaryings[i] * invW1, v2.pVaryings[i] * invW2);
 	}
 
-	constexpr float lightIntensity{ 7.f };
-	constexpr float shininess{ 25.f };
-	const ColorRGB ambient{ .03f, .03f, .03f };
-
-	// Diffuse
-	const ColorRGB diffuseMapSample{ material.pDiffuse->Sample(vertex.uv) };
-	const ColorRGB diffuse{ BRDF::Lambert(1.f, diffuseMapSample)};
+	return planes;
+}
 
-	const ColorRGB specularMapSample{ material.pSpecular->Sample(vertex.uv) };
-	const ColorRGB glossinessMapSample{ material.pGloss->Sample(vertex.uv) };
-	const ColorRGB glossiness{ glossinessMapSample * shininess };
+template<typename State>
+ColorRGB Renderer::ShadePixel(int px, int py, float viewDepth, uint32_t triangleIndex) const
+{
+	const AttributePlanes& planes{ m_TrianglePlanes[triangleIndex] };
+	const float x{ static_cast<float>(px - planes.origin.x) };
+	const float y{ static_cast<float>(py - planes.origin.y) };
 
-	const ColorRGB specular{ BRDF::Phong(
-		specularMapSample,
-		glossiness,
-		lightDirection,
-		vertex.viewDirection,
-		normal
-	) };
+	if constexpr (State::renderMode == RenderMode::depth)
+	{
+		const float projectedDepth{ 1.f / planes.invDepth.Evaluate(x, y) };
 
-	switch (m_ShadingMode)
+		const float remapMin{ 0.995f };
+		const float remapMax{ 1.0f };
+		const float depthColor{ (Clamp(projectedDepth, remapMin, remapMax) - remapMin) / (remapMax - remapMin) };
+		return ColorRGB{ depthColor,depthColor,depthColor };
+	}
+	else
 	{
-	case ShadingMode::combined:
-		return ((colors::White * lightIntensity * diffuse) + ambient + specular) * observedArea;
-	case ShadingMode::observedArea:
-		return ColorRGB{ observedArea,observedArea,observedArea };
-	case ShadingMode::diffuse:
-		return colors::White * lightIntensity * diffuse * observedArea;
-	case ShadingMode::specular:
-		return specular;
+		const Material& material{ *m_Triangles[triangleIndex].pMaterial };
+		return SceneShaders::Visit(material.shaderId, [&]<typename Shader>(std::type_identity<Shader>)
+			{
+				// Planes hold varying / w, multiplying by the view depth undoes the division
+				VaryingArray<Shader> varyings{};
+				for (size_t i{ 0 }; i < UsedVaryingCount<Shader>(State::usingNormalMap); ++i)
+				{
+					varyings[i] = planes.varyings[i].Evaluate(x, y) * viewDepth;
+				}
+
+				// The planes hold varying / w, so by the quotient rule d(varying)/dx = (d(varying / w)/dx - varying * d(1 / w)/dx) * w
+				constexpr size_t u{ Shader::TEXCOORD_VARYING };
+				constexpr size_t v{ Shader::TEXCOORD_VARYING + 1 };
+				const TextureCoordinate texCoord{
+					Vector2{ varyings[u], varyings[v] },
+					Vector2{
+						(planes.varyings[u].dx - varyings[u] * planes.invW.dx) * viewDepth,
+						(planes.varyings[v].dx - varyings[v] * planes.invW.dx) * viewDepth
+					},
+					Vector2{
+						(planes.varyings[u].dy - varyings[u] * planes.invW.dy) * viewDepth,
+						(planes.varyings[v].dy - varyings[v] * planes.invW.dy) * viewDepth
+					}
+				};
+
+				return Shader::template ShadePixel<State>(std::bit_cast<typename Shader::Varyings>(varyings), texCoord,
+					m_ShadingContext, material);
+			});
 	}
+}
+
+template<typename Shader>
+size_t Renderer::AddMaterial(const std::string& diffuse, const std::string& normal, const std::string& specular,
+	const std::string& gloss)
+{
+	Texture* diffuseTexture{ nullptr };
+	if (!diffuse.empty()) diffuseTexture = Texture::LoadFromFile(diffuse);
 
-	return {};
+	Texture* normalTexture{ nullptr };
+	if (!normal.empty()) normalTexture = Texture::LoadFromFile(normal);
+
+	Texture* specularTexture{ nullptr };
+	if (!specular.empty()) specularTexture = Texture::LoadFromFile(specular);
+
+	Texture* glossTexture{ nullptr };
+	if (!gloss.empty()) glossTexture = Texture::LoadFromFile(gloss);
+
+
+	// IndexOf rejects shaders missing from SceneShaders, this keeps the id it hands out within range of Visit
+	constexpr size_t shaderId{ SceneShaders::IndexOf<Shader>() };
+	static_assert(shaderId < SceneShaders::COUNT);
+
+	m_Materials.push_back(Material{ diffuseTexture, normalTexture, specularTexture, glossTexture, shaderId });
+	return m_Materials.size() - 1;
 }
 
+
 bool Renderer::SaveBufferToImage() const
 {
-	return SDL_SaveBMP(m_pBackBuffer, "Rasterizer_ColorBuffer.bmp");
+	return SDL_SaveBMP(m_FrameBuffer.GetSurface(), "Rasterizer_ColorBuffer.bmp");
 }
@@ -4,7 +4,15 @@
 #include <vector>
 
 #include "Camera.h"
+#include "Clipping.h"
 #include "DataTypes.h"
+#include "FrameBuffer.h"
+#include "PhongShader.h"
+#include "RasterKernels.h"
+#include "Shaders.h"
+#include "ThreadPool.h"
+#include "TransformKernels.h"
+#include "Utils.h"
 
 struct SDL_Window;
 struct SDL_Surface;
@@ -33,6 +41,30 @@ namespace dae
 			specular
 		};
 
+		enum class CullMode
+		{
+			none, back, front
+		};
+
+		// Every shader a material can use, new ones are added here. See Shaders.h for what a shader provides.
+		using SceneShaders = ShaderList<PhongShader>;
+
+		// Counted per frame, screen triangles produced by clipping are counted individually
+		struct TriangleStats
+		{
+			uint32_t submitted{};
+			uint32_t frustumCulled{};
+			uint32_t backfaceCulled{};
+			uint32_t degenerateCulled{};
+			uint32_t noCoverageCulled{};
+			uint32_t rasterized{};
+
+			// Meshes and instances rejected against the frustum as a whole, their triangles aren't counted as submitted
+			uint32_t meshesCulled{};
+			uint32_t meshletsFrustumCulled{};
+			uint32_t meshletsBackfaceCulled{};
+		};
+
 		explicit Renderer(SDL_Window* pWindow);
 		~Renderer();
 
@@ -46,7 +78,12 @@ namespace dae
 
 		bool SaveBufferToImage() const;
 
-		void WorldToScreen(Mesh& mesh) const;
+		void WorldToScreen(Mesh& mesh);
+
+		// Draws the mesh once per instance. Its vertices and indices are stored once, only instances that survive
+		// culling are transformed, into buffers reused every frame. Returns the index to pass to GetInstances.
+		size_t AddInstancedMesh(Mesh&& mesh, std::vector<MeshInstance> instances = {});
+		std::vector<MeshInstance>& GetInstances(size_t instancedMeshIndex) { return m_InstancedMeshes[instancedMeshIndex].instances; }
 
 		Vector4 NdcToScreen(Vector4 ndc) const;
 
@@ -54,16 +91,114 @@ namespace dae
 		void CycleRotationMode();
 		void CycleShadingMode();
 		void CycleNormalMode();
+		void CycleCullMode();
+		void ToggleVisibilityBuffer();
+		void CycleTextureFilter();
+
+		const TriangleStats& GetTriangleStats() const { return m_TriangleStats; }
 
 	private:
+		// Post-transform triangle with its edge functions set up once for every tile it touches
+		struct RasterTriangle
+		{
+			const Material* pMaterial{};
+
+			GeometryUtils::TriangleEdges edges{};
+			GeometryUtils::ScreenBoundingBox bound{};
+
+			float invW0{};
+			float invW1{};
+			float invW2{};
+
+			// Nearest view depth of any vertex, the triangle can't get closer than this anywhere
+			float minDepth{};
+		};
+
+		// The material's shader varyings divided by w and 1/z as planes relative to origin, so interpolating them
+		// takes two multiply-adds each and perspective correction reuses the view depth from the depth test.
+		// Only the first UsedVaryingCount<Shader> planes are set up.
+		struct AttributePlanes
+		{
+			Vector2i origin{};
+
+			GeometryUtils::InterpolationPlane invDepth{};
+
+			// 1 / w, its gradient turns the gradients of the varying planes into derivatives of the varyings themselves
+			GeometryUtils::InterpolationPlane invW{};
+			GeometryUtils::InterpolationPlane varyings[SceneShaders::MAX_VARYING_COUNT]{};
+		};
+
+		struct InstancedMesh
+		{
+			Mesh mesh{};
+			std::vector<MeshInstance> instances{};
+		};
+
+		// Transformed vertices of one instance, only needed until its triangles are binned
+		struct InstanceVertices
+		{
+			PositionStreams worldPositions{};
+			std::vector<Vertex_Out> vertices{};
+			std::vector<Vector4> clipPositions{};
+			std::vector<uint8_t> clipFlags{};
+			std::vector<float> varyings{};
+		};
+
+		// Corner of a triangle as binning sees it, everything but the position was left to the vertex shader
+		struct ScreenVertex
+		{
+			Vector4 position{};
+
+			// VARYING_STRIDE floats, of which the material's shader uses the first VARYING_COUNT<Shader>
+			const float* pVaryings{};
+		};
+
+		struct VisibleInstance
+		{
+			const MeshInstance* pInstance{};
+			size_t lodIndex{};
+		};
+
+		// Everything the pixel pipeline branches on. It is resolved once per frame and passed as a template argument,
+		// so every combination compiles into its own loops without the work it doesn't use.
+		template<RenderMode Mode, ShadingMode Shading, bool NormalMap, bool VisibilityBuffer>
+		struct PipelineState
+		{
+			static constexpr RenderMode renderMode{ Mode };
+			static constexpr ShadingMode shadingMode{ Shading };
+			static constexpr bool usingNormalMap{ NormalMap };
+			static constexpr bool usingVisibilityBuffer{ VisibilityBuffer };
+
+			static constexpr bool usesDiffuse{ Shading == ShadingMode::combined || Shading == ShadingMode::diffuse };
+			static constexpr bool usesSpecular{ Shading == ShadingMode::combined || Shading == ShadingMode::specular };
+		};
+
+		struct Tile
+		{
+			GeometryUtils::ScreenBoundingBox bound{};
+			std::vector<uint32_t> triangleIndices{};
+
+			// The frame buffer still holds its clear values here, so a tile without triangles can be skipped entirely
+			bool isClear{ false };
+		};
+
+		static constexpr int TILE_SIZE{ 64 };
+
+		// Floats per vertex in the varying buffers, enough for any shader in SceneShaders
+		static constexpr size_t VARYING_STRIDE{ SceneShaders::MAX_VARYING_COUNT };
+
+		// A block row is exactly one kernel span
+		static constexpr int BLOCK_SIZE{ RasterKernels::SPAN_WIDTH };
+
 		std::vector<Mesh> m_SceneMeshes{};
+		std::vector<InstancedMesh> m_InstancedMeshes{};
 		std::vector<Material> m_Materials{};
 
 		SDL_Window* m_pWindow{};
 
 		SDL_Surface* m_pFrontBuffer{ nullptr };
-		SDL_Surface* m_pBackBuffer{ nullptr };
-		uint32_t* m_pBackBufferPixels{};
+		FrameBuffer m_FrameBuffer{};
+		uint32_t m_ClearColor{};
 
 		Camera m_Camera{};
 
@@ -72,19 +207,149 @@ namespace dae
 
 		RenderMode m_RenderMode{};
 		ShadingMode m_ShadingMode{};
+		CullMode m_CullMode{ CullMode::back };
 		bool m_Rotating{ true };
 		bool m_UsingNormalMap{ true };
 
+		// Rasterize triangle IDs first and shade every visible pixel once afterwards
+		bool m_UsingVisibilityBuffer{ true };
+
+		TextureFilter m_TextureFilter{ TextureFilter::bilinear };
+
 		float m_CurrentRotation{ 0.f };
 
-		void RenderScreenTri(
-			const Vertex_Out& v0,
-			const Vertex_Out& v1,
-			const Vertex_Out& v2,
-			const Material& mat,
-			float* depthBuffer
+		ThreadPool m_ThreadPool{};
+		std::vector<RasterTriangle> m_Triangles{};
+		std::vector<AttributePlanes> m_TrianglePlanes{};
+		std::vector<Tile> m_Tiles{};
+
+		float m_GuardBandX{};
+		float m_GuardBandY{};
+
+		TriangleStats m_TriangleStats{};
+		ShadingContext m_ShadingContext{};
+
+		RasterKernels::SpanKernels m_SpanKernels{};
+		TransformKernels::StageKernels m_TransformKernels{};
+
+		// Vertices per transform job, smaller meshes are transformed on the calling thread
+		static constexpr size_t TRANSFORM_CHUNK_SIZE{ 4096 };
+
+		// Reorders loaded meshes for vertex reuse and fetch locality, see MeshOptimizer
+		static constexpr bool OPTIMIZE_MESHES{ true };
+
+		// Splits loaded meshes into meshlets that are culled and transformed on their own
+		static constexpr bool BUILD_MESHLETS{ true };
+
+		// Generates simplified LODs for loaded meshes, picked per frame so their error stays below LOD_PIXEL_ERROR on screen
+		static constexpr bool BUILD_LODS{ true };
+		static constexpr float LOD_PIXEL_ERROR{ 0.5f };
+
+		// Instances transformed together before their triangles are assembled, bounds the memory instancing needs
+		static constexpr size_t INSTANCE_GROUP_SIZE{ 16 };
+
+		// Copies of the vehicle drawn through AddInstancedMesh on a grid behind it, 0 leaves the scene as is
+		static constexpr int FLEET_SIZE{ 0 };
+
+		std::vector<Meshlet*> m_VisibleMeshlets{};
+		std::vector<VisibleInstance> m_VisibleInstances{};
+		std::vector<InstanceVertices> m_InstanceVertices{};
+
+		void Resize(int width, int height);
+		void InitializeTiles();
+
+		void RenderMeshlets(Mesh& mesh, const Clipping::Frustum& frustum, const Material& material);
+		void RenderInstances(InstancedMesh& instancedMesh, const Clipping::Frustum& frustum);
+
+		// Sizes the mesh's transform outputs to its vertices, invalidating everything cached if that changed anything
+		void PrepareVertexBuffers(Mesh& mesh) const;
+		TransformKernels::ScreenSetup GetScreenSetup() const;
+		void TransformVertices(
+			const Mesh& mesh,
+			const Matrix& world,
+			PositionStreams& worldPositions,
+			const TransformKernels::TransformOutput& output,
+			const TransformKernels::ScreenSetup& setup,
+			size_t begin,
+			size_t end,
+			bool isWorldStale
 		) const;
 
+		// Runs the material's vertex shader on the transformed vertices [begin, end) and stores their varyings
+		void ShadeVertices(const Material& material, const TransformKernels::TransformOutput& output, size_t begin, size_t end) const;
+
+		void AssembleTriangles(
+			const TransformKernels::TransformOutput& vertices,
+			PrimitiveTopology topology,
+			const std::vector<uint32_t>& indices,
+			const Material& mat
+		);
+
+		void AssembleTriangle(
+			const TransformKernels::TransformOutput& vertices,
+			uint32_t i0,
+			uint32_t i1,
+			uint32_t i2,
+			const Material& mat
+		);
+
+		void ClipAndBinTriangle(
+			const TransformKernels::TransformOutput& vertices,
+			uint32_t i0,
+			uint32_t i1,
+			uint32_t i2,
+			uint8_t clipFlags,
+			const Material& mat
+		);
+
+		// Index into mesh.lods plus one, 0 is the full mesh
+		size_t SelectLod(const Mesh& mesh, const Matrix& world) const;
+
+		bool IsFaceCulled(int64_t signedDoubleArea) const;
+
+		// Normal cone test, true when the cull mode would reject every triangle of the meshlet
+		bool IsMeshletFaceCulled(const Meshlet& meshlet, const Matrix& world) const;
+
+		void BinScreenTri(
+			const ScreenVertex& v0,
+			const ScreenVertex& v1,
+			const ScreenVertex& v2,
+			const Material& mat
+		);
+
+		using TileRenderer = void (Renderer::*)(Tile&) const;
+
+		// RenderTile instantiated for the current modes
+		TileRenderer SelectTileRenderer() const;
+		template<ShadingMode Shading>
+		TileRenderer SelectTileRenderer() const;
+
+		template<typename State>
+		void RenderTile(Tile& tile) const;
+
+		// Returns whether any depth was written
+		template<typename State>
+		bool RenderScreenTri(uint32_t triangleIndex, const GeometryUtils::ScreenBoundingBox& tileBound) const;
+
+		float GetBlockMaxDepth(int blockX, int blockY) const;
+
+		template<typename State>
+		void ResolveTile(const Tile& tile) const;
+
+		template<typename Shader>
+		static AttributePlanes SetupAttributePlanes(
+			const GeometryUtils::TriangleEdges& edges,
+			const Vector2i& origin,
+			const ScreenVertex& v0,
+			const ScreenVertex& v1,
+			const ScreenVertex& v2,
+			size_t varyingCount
+		);
+
+		template<typename State>
+		ColorRGB ShadePixel(int px, int py, float viewDepth, uint32_t triangleIndex) const;
+
+		template<typename Shader = PhongShader>
 		size_t AddMaterial(
 			const std::string& diffuse = "",
 			const std::string& normal = "",
@@ -92,8 +357,6 @@ namespace dae
 			const std::string& gloss = ""
 		);
 
-		ColorRGB Shade(const Vertex_Out& vertex, const Material& material) const;
-
 
 	};
 }
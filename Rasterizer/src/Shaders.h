@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	// Per frame inputs of the shaders
+	struct ShadingContext
+	{
+		Vector3 cameraOrigin{};
+		TextureFilter textureFilter{ TextureFilter::bilinear };
+	};
+
+	// Most floats any shader's Varyings may hold, clipping makes room for this many per vertex
+	constexpr size_t VARYING_CAPACITY{ 16 };
+
+	// A shader is a stateless type with
+	//   Varyings, a struct of at most VARYING_CAPACITY floats the rasterizer interpolates perspective correct across each
+	//     triangle. Only what ShadePixel reads belongs in there, every float costs a plane per triangle and a multiply-add
+	//     per pixel.
+	//   TEXCOORD_VARYING, the index of the first of the two varyings textures are sampled with. The renderer
+	//     differentiates those across the screen, which is what picks the mip level.
+	//   NORMAL_MAP_VARYINGS, how many of the last varyings ShadePixel only reads when normal mapping is on. With it off
+	//     the renderer neither sets up nor interpolates them.
+	//   static Varyings ShadeVertex(const Vertex_Out& vertex, const ShadingContext& context), run once per vertex in
+	//     the transform pass, unpacking whatever the shader needs from the compact vertex. Cached vertices are only
+	//     shaded again when they or the camera moved, so of the context it may only read cameraOrigin.
+	//   template<typename State> static ColorRGB ShadePixel(const Varyings& varyings, const TextureCoordinate& texCoord,
+	//     const ShadingContext& context, const Material& material), run once per visible pixel, State being the
+	//     Renderer's PipelineState
+	// The renderer only calls shaders through ShaderList, so their bodies are inlined into the pixel loops.
+	template<typename Shader>
+	concept ShaderType =
+		std::is_trivially_copyable_v<typename Shader::Varyings> &&
+		sizeof(typename Shader::Varyings) % sizeof(float) == 0 &&
+		sizeof(typename Shader::Varyings) / sizeof(float) <= VARYING_CAPACITY &&
+		Shader::NORMAL_MAP_VARYINGS <= sizeof(typename Shader::Varyings) / sizeof(float) &&
+		Shader::TEXCOORD_VARYING + 2 <= sizeof(typename Shader::Varyings) / sizeof(float) - Shader::NORMAL_MAP_VARYINGS &&
+		requires(const Vertex_Out& vertex, const ShadingContext& context)
+	{
+		{ Shader::ShadeVertex(vertex, context) } -> std::same_as<typename Shader::Varyings>;
+	};
+
+	template<ShaderType Shader>
+	constexpr size_t VARYING_COUNT{ sizeof(typename Shader::Varyings) / sizeof(float) };
+
+	template<ShaderType Shader>
+	using VaryingArray = std::array<float, VARYING_COUNT<Shader>>;
+
+	// How many leading varyings ShadePixel reads, the others only matter with a normal map
+	template<ShaderType Shader>
+	constexpr size_t UsedVaryingCount(bool usingNormalMap)
+	{
+		return usingNormalMap ? VARYING_COUNT<Shader> : VARYING_COUNT<Shader> - Shader::NORMAL_MAP_VARYINGS;
+	}
+
+	// Compile time list of the shaders materials can pick from, Material::shaderId indexes it
+	template<ShaderType... Shaders>
+	struct ShaderList final
+	{
+		static constexpr size_t COUNT{ sizeof...(Shaders) };
+		static constexpr size_t MAX_VARYING_COUNT{ std::max({ VARYING_COUNT<Shaders>... }) };
+
+		template<typename Shader>
+		static constexpr size_t IndexOf()
+		{
+			static_assert((std::is_same_v<Shader, Shaders> || ...), "Shader isn't part of the list");
+
+			constexpr bool isMatch[]{ std::is_same_v<Shader, Shaders>... };
+
+			size_t index{ 0 };
+			while (!isMatch[index]) ++index;
+			return index;
+		}
+
+		// Calls function with std::type_identity<Shader> of the shader at shaderId, which compiles to a switch
+		template<typename Function>
+		static decltype(auto) Visit(size_t shaderId, Function&& function)
+		{
+			assert(shaderId < COUNT && "Shader id out of range, materials get theirs from Renderer::AddMaterial");
+			return VisitFrom<Shaders...>(shaderId, std::forward<Function>(function));
+		}
+
+	private:
+		template<typename Shader, typename... Rest, typename Function>
+		static decltype(auto) VisitFrom(size_t shaderId, Function&& function)
+		{
+			// Visit only lets valid ids through, so the last shader doesn't have to compare its own
+			if constexpr (sizeof...(Rest) == 0)
+			{
+				return function(std::type_identity<Shader>{});
+			}
+			else
+			{
+				if (shaderId == 0) return function(std::type_identity<Shader>{});
+				return VisitFrom<Rest...>(shaderId - 1, std::forward<Function>(function));
+			}
+		}
+	};
+}
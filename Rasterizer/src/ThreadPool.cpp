@@ -0,0 +1,79 @@
+#include "ThreadPool.h"
+
+using namespace dae;
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	for (size_t i{ 1 }; i < threadCount; ++i)
+	{
+		m_Workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_IsShuttingDown = true;
+	}
+	m_WorkAvailable.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0) return;
+
+	{
+		std::lock_guard lock{ m_Mutex };
+		m_pJob = &job;
+		m_JobCount = count;
+		m_NextJob = 0;
+		m_BusyWorkers = m_Workers.size();
+		++m_Generation;
+	}
+	m_WorkAvailable.notify_all();
+
+	RunJobs();
+
+	std::unique_lock lock{ m_Mutex };
+	m_WorkDone.wait(lock, [this] { return m_BusyWorkers == 0; });
+	m_pJob = nullptr;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	uint64_t lastGeneration{};
+
+	while (true)
+	{
+		{
+			std::unique_lock lock{ m_Mutex };
+			m_WorkAvailable.wait(lock, [&] { return m_IsShuttingDown || m_Generation != lastGeneration; });
+
+			if (m_IsShuttingDown) return;
+			lastGeneration = m_Generation;
+		}
+
+		RunJobs();
+
+		{
+			std::lock_guard lock{ m_Mutex };
+			--m_BusyWorkers;
+		}
+		m_WorkDone.notify_one();
+	}
+}
+
+void ThreadPool::RunJobs()
+{
+	// Jobs are handed out one at a time, so threads that finish early pick up the remaining ones
+	for (size_t job{ m_NextJob++ }; job < m_JobCount; job = m_NextJob++)
+	{
+		(*m_pJob)(job);
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace dae
+{
+	class ThreadPool final
+	{
+	public:
+		// The calling thread also works on ParallelFor jobs, so it only spawns threadCount - 1 workers
+		explicit ThreadPool(size_t threadCount = std::thread::hardware_concurrency());
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool(ThreadPool&&) noexcept = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		ThreadPool& operator=(ThreadPool&&) noexcept = delete;
+
+		// Calls job(index) for every index in [0, count) and returns once all of them are done
+		void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+		size_t GetThreadCount() const { return m_Workers.size() + 1; }
+
+	private:
+		std::vector<std::thread> m_Workers{};
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_WorkAvailable{};
+		std::condition_variable m_WorkDone{};
+
+		const std::function<void(size_t)>* m_pJob{ nullptr };
+		size_t m_JobCount{};
+		std::atomic<size_t> m_NextJob{};
+
+		size_t m_BusyWorkers{};
+		uint64_t m_Generation{};
+		bool m_IsShuttingDown{ false };
+
+		void WorkerLoop();
+		void RunJobs();
+	};
+}
@@ -0,0 +1,313 @@
+#include "TransformKernels.h"
+
+#include <immintrin.h>
+
+#include "SDL_cpuinfo.h"
+
+#include "Clipping.h"
+#include "VertexPacking.h"
+
+using namespace dae;
+
+namespace
+{
+	void TransformToWorld(const Matrix& world, const VertexStreams& streams, const Vertex* pVertices, size_t index, PositionStreams& worldPositions, Vertex_Out* pVerticesOut)
+	{
+		const Vector3 position{ streams.positionX[index], streams.positionY[index], streams.positionZ[index] };
+		const Vector3 normal{ streams.normalX[index], streams.normalY[index], streams.normalZ[index] };
+		const Vector3 tangent{ streams.tangentX[index], streams.tangentY[index], streams.tangentZ[index] };
+
+		// Mesh > World
+		const Vector3 worldPosition{ world.TransformPoint(position) };
+		worldPositions.x[index] = worldPosition.x;
+		worldPositions.y[index] = worldPosition.y;
+		worldPositions.z[index] = worldPosition.z;
+
+		Vertex_Out& vertexOut{ pVerticesOut[index] };
+		vertexOut.color = pVertices[index].color;
+		vertexOut.uv = pVertices[index].uv;
+		vertexOut.normal = PackOctahedral(world.TransformVector(normal));
+		vertexOut.tangent = PackOctahedral(world.TransformVector(tangent));
+		vertexOut.worldPosition = worldPosition;
+	}
+
+	void TransformToScreen(const TransformKernels::ScreenSetup& setup, const PositionStreams& worldPositions, size_t index, const TransformKernels::TransformOutput& output)
+	{
+		const Vector3 worldPosition{ worldPositions.x[index], worldPositions.y[index], worldPositions.z[index] };
+
+		// World > View > Clipping
+		const Vector4 clipPosition{ setup.viewProjection.TransformPoint({ worldPosition, 1 }) };
+		output.pClipPositions[index] = clipPosition;
+		output.pClipFlags[index] = Clipping::ComputeClipFlags(clipPosition, setup.guardBandX, setup.guardBandY);
+
+		// Perspective Divide > Screen
+		Vertex_Out& vertexOut{ output.pVertices[index] };
+		vertexOut.position = {
+			(clipPosition.x / clipPosition.w + 1.f) / 2.f * setup.screenWidth,
+			(1.f - clipPosition.y / clipPosition.w) / 2.f * setup.screenHeight,
+			clipPosition.z / clipPosition.w,
+			clipPosition.w
+		};
+	}
+
+	struct MatrixAVX
+	{
+		__m256 m[4][4];
+
+		explicit MatrixAVX(const Matrix& matrix)
+		{
+			for (int row{ 0 }; row < 4; ++row)
+			{
+				for (int column{ 0 }; column < 4; ++column)
+				{
+					m[row][column] = _mm256_set1_ps(matrix[row][column]);
+				}
+			}
+		}
+
+		// Same operation order as Matrix::TransformPoint and TransformVector, so results match the scalar path exactly
+		__m256 Point(int column, __m256 x, __m256 y, __m256 z) const
+		{
+			return _mm256_add_ps(Vector(column, x, y, z), m[3][column]);
+		}
+
+		__m256 Vector(int column, __m256 x, __m256 y, __m256 z) const
+		{
+			return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0][column], x), _mm256_mul_ps(m[1][column], y)), _mm256_mul_ps(m[2][column], z));
+		}
+	};
+
+	// Same steps as PackOctahedral
+	__m256i PackOctahedralAVX(__m256 x, __m256 y, __m256 z)
+	{
+		const __m256 zero{ _mm256_setzero_ps() };
+		const __m256 one{ _mm256_set1_ps(1.f) };
+		const __m256 minusOne{ _mm256_set1_ps(-1.f) };
+		const __m256 signBit{ _mm256_set1_ps(-0.f) };
+
+		const __m256 absX{ _mm256_andnot_ps(signBit, x) };
+		const __m256 absY{ _mm256_andnot_ps(signBit, y) };
+		const __m256 absZ{ _mm256_andnot_ps(signBit, z) };
+		const __m256 length{ _mm256_add_ps(_mm256_add_ps(absX, absY), absZ) };
+		const __m256 isInvalid{ _mm256_cmp_ps(length, zero, _CMP_NGT_UQ) };
+
+		__m256 octX{ _mm256_div_ps(x, length) };
+		__m256 octY{ _mm256_div_ps(y, length) };
+
+		const __m256 signX{ _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(octX, zero, _CMP_GE_OQ)) };
+		const __m256 signY{ _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(octY, zero, _CMP_GE_OQ)) };
+		const __m256 foldedX{ _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signBit, octY)), signX) };
+		const __m256 foldedY{ _mm256_mul_ps(_mm256_sub_ps(one, _mm256_andnot_ps(signBit, octX)), signY) };
+
+		const __m256 isLowerHalf{ _mm256_cmp_ps(z, zero, _CMP_LT_OQ) };
+		octX = _mm256_blendv_ps(octX, foldedX, isLowerHalf);
+		octY = _mm256_blendv_ps(octY, foldedY, isLowerHalf);
+
+		const __m256 scale{ _mm256_set1_ps(32767.f) };
+		const __m256i snormX{ _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(octX, minusOne), one), scale)) };
+		const __m256i snormY{ _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(octY, minusOne), one), scale)) };
+
+		// AVX has no 256-bit integer operations, so the snorms are packed in two SSE2 halves
+		const auto packHalf{ [](__m128i halfX, __m128i halfY)
+			{
+				return _mm_or_si128(_mm_and_si128(halfX, _mm_set1_epi32(0xFFFF)), _mm_slli_epi32(halfY, 16));
+			} };
+		const __m256i packed{ _mm256_set_m128i(
+			packHalf(_mm256_extractf128_si256(snormX, 1), _mm256_extractf128_si256(snormY, 1)),
+			packHalf(_mm256_castsi256_si128(snormX), _mm256_castsi256_si128(snormY))
+		) };
+		return _mm256_castps_si256(_mm256_andnot_ps(isInvalid, _mm256_castsi256_ps(packed)));
+	}
+
+	__m256 FlagIf(__m256 condition, uint8_t flag)
+	{
+		return _mm256_and_ps(condition, _mm256_castsi256_ps(_mm256_set1_epi32(flag)));
+	}
+}
+
+void TransformKernels::ToWorld_Scalar(const Matrix& world, const VertexStreams& streams, const Vertex* pVertices, size_t begin, size_t end, PositionStreams& worldPositions, Vertex_Out* pVerticesOut)
+{
+	for (size_t i{ begin }; i < end; ++i)
+	{
+		TransformToWorld(world, streams, pVertices, i, worldPositions, pVerticesOut);
+	}
+}
+
+void TransformKernels::ToWorld_AVX(const Matrix& world, const VertexStreams& streams, const Vertex* pVertices, size_t begin, size_t end, PositionStreams& worldPositions, Vertex_Out* pVerticesOut)
+{
+	const MatrixAVX worldAVX{ world };
+
+	size_t i{ begin };
+	for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH)
+	{
+		const __m256 positionX{ _mm256_loadu_ps(streams.positionX.data() + i) };
+		const __m256 positionY{ _mm256_loadu_ps(streams.positionY.data() + i) };
+		const __m256 positionZ{ _mm256_loadu_ps(streams.positionZ.data() + i) };
+
+		// Mesh > World
+		const __m256 worldX{ worldAVX.Point(0, positionX, positionY, positionZ) };
+		const __m256 worldY{ worldAVX.Point(1, positionX, positionY, positionZ) };
+		const __m256 worldZ{ worldAVX.Point(2, positionX, positionY, positionZ) };
+		_mm256_storeu_ps(worldPositions.x.data() + i, worldX);
+		_mm256_storeu_ps(worldPositions.y.data() + i, worldY);
+		_mm256_storeu_ps(worldPositions.z.data() + i, worldZ);
+
+		const __m256 localNormalX{ _mm256_loadu_ps(streams.normalX.data() + i) };
+		const __m256 localNormalY{ _mm256_loadu_ps(streams.normalY.data() + i) };
+		const __m256 localNormalZ{ _mm256_loadu_ps(streams.normalZ.data() + i) };
+		const __m256i normal{ PackOctahedralAVX(
+			worldAVX.Vector(0, localNormalX, localNormalY, localNormalZ),
+			worldAVX.Vector(1, localNormalX, localNormalY, localNormalZ),
+			worldAVX.Vector(2, localNormalX, localNormalY, localNormalZ)
+		) };
+
+		const __m256 localTangentX{ _mm256_loadu_ps(streams.tangentX.data() + i) };
+		const __m256 localTangentY{ _mm256_loadu_ps(streams.tangentY.data() + i) };
+		const __m256 localTangentZ{ _mm256_loadu_ps(streams.tangentZ.data() + i) };
+		const __m256i tangent{ PackOctahedralAVX(
+			worldAVX.Vector(0, localTangentX, localTangentY, localTangentZ),
+			worldAVX.Vector(1, localTangentX, localTangentY, localTangentZ),
+			worldAVX.Vector(2, localTangentX, localTangentY, localTangentZ)
+		) };
+
+		// Vertex_Out is laid out per vertex, so the results are written out lane by lane
+		alignas(32) float results[3][BATCH_WIDTH];
+		alignas(32) uint32_t packedResults[2][BATCH_WIDTH];
+		_mm256_store_ps(results[0], worldX);
+		_mm256_store_ps(results[1], worldY);
+		_mm256_store_ps(results[2], worldZ);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(packedResults[0]), normal);
+		_mm256_store_si256(reinterpret_cast<__m256i*>(packedResults[1]), tangent);
+
+		for (int lane{ 0 }; lane < BATCH_WIDTH; ++lane)
+		{
+			const size_t index{ i + lane };
+
+			Vertex_Out& vertexOut{ pVerticesOut[index] };
+			vertexOut.color = pVertices[index].color;
+			vertexOut.uv = pVertices[index].uv;
+			vertexOut.normal = packedResults[0][lane];
+			vertexOut.tangent = packedResults[1][lane];
+			vertexOut.worldPosition = { results[0][lane], results[1][lane], results[2][lane] };
+		}
+	}
+
+	ToWorld_Scalar(world, streams, pVertices, i, end, worldPositions, pVerticesOut);
+}
+
+void TransformKernels::ToScreen_Scalar(const ScreenSetup& setup, const PositionStreams& worldPositions, size_t begin, size_t end, const TransformOutput& output)
+{
+	for (size_t i{ begin }; i < end; ++i)
+	{
+		TransformToScreen(setup, worldPositions, i, output);
+	}
+}
+
+void TransformKernels::ToScreen_AVX(const ScreenSetup& setup, const PositionStreams& worldPositions, size_t begin, size_t end, const TransformOutput& output)
+{
+	const MatrixAVX viewProjection{ setup.viewProjection };
+
+	const __m256 zero{ _mm256_setzero_ps() };
+	const __m256 one{ _mm256_set1_ps(1.f) };
+	const __m256 half{ _mm256_set1_ps(0.5f) };
+	const __m256 screenWidth{ _mm256_set1_ps(setup.screenWidth) };
+	const __m256 screenHeight{ _mm256_set1_ps(setup.screenHeight) };
+	const __m256 guardBandX{ _mm256_set1_ps(setup.guardBandX) };
+	const __m256 guardBandY{ _mm256_set1_ps(setup.guardBandY) };
+
+	size_t i{ begin };
+	for (; i + BATCH_WIDTH <= end; i += BATCH_WIDTH)
+	{
+		const __m256 positionX{ _mm256_loadu_ps(worldPositions.x.data() + i) };
+		const __m256 positionY{ _mm256_loadu_ps(worldPositions.y.data() + i) };
+		const __m256 positionZ{ _mm256_loadu_ps(worldPositions.z.data() + i) };
+
+		// World > View > Clipping
+		const __m256 clipX{ viewProjection.Point(0, positionX, positionY, positionZ) };
+		const __m256 clipY{ viewProjection.Point(1, positionX, positionY, positionZ) };
+		const __m256 clipZ{ viewProjection.Point(2, positionX, positionY, positionZ) };
+		const __m256 clipW{ viewProjection.Point(3, positionX, positionY, positionZ) };
+
+		// Same tests as Clipping::ComputeClipFlags, every lane ends up holding its flags as an integer
+		const __m256 negativeW{ _mm256_sub_ps(zero, clipW) };
+		const __m256 guardX{ _mm256_mul_ps(guardBandX, clipW) };
+		const __m256 guardY{ _mm256_mul_ps(guardBandY, clipW) };
+		const __m256 flags{
+			_mm256_or_ps(
+				_mm256_or_ps(
+					_mm256_or_ps(FlagIf(_mm256_cmp_ps(clipX, negativeW, _CMP_LT_OQ), Clipping::CLIP_LEFT), FlagIf(_mm256_cmp_ps(clipX, clipW, _CMP_GT_OQ), Clipping::CLIP_RIGHT)),
+					_mm256_or_ps(FlagIf(_mm256_cmp_ps(clipY, negativeW, _CMP_LT_OQ), Clipping::CLIP_BOTTOM), FlagIf(_mm256_cmp_ps(clipY, clipW, _CMP_GT_OQ), Clipping::CLIP_TOP))
+				),
+				_mm256_or_ps(
+					_mm256_or_ps(FlagIf(_mm256_cmp_ps(clipZ, zero, _CMP_LT_OQ), Clipping::CLIP_NEAR), FlagIf(_mm256_cmp_ps(clipZ, clipW, _CMP_GT_OQ), Clipping::CLIP_FAR)),
+					_mm256_or_ps(
+						FlagIf(_mm256_or_ps(_mm256_cmp_ps(clipX, _mm256_sub_ps(zero, guardX), _CMP_LT_OQ), _mm256_cmp_ps(clipX, guardX, _CMP_GT_OQ)), Clipping::CLIP_GUARD_X),
+						FlagIf(_mm256_or_ps(_mm256_cmp_ps(clipY, _mm256_sub_ps(zero, guardY), _CMP_LT_OQ), _mm256_cmp_ps(clipY, guardY, _CMP_GT_OQ)), Clipping::CLIP_GUARD_Y)
+					)
+				)
+			)
+		};
+
+		// Perspective Divide > Screen
+		const __m256 screenX{ _mm256_mul_ps(_mm256_mul_ps(_mm256_add_ps(_mm256_div_ps(clipX, clipW), one), half), screenWidth) };
+		const __m256 screenY{ _mm256_mul_ps(_mm256_mul_ps(_mm256_sub_ps(one, _mm256_div_ps(clipY, clipW)), half), screenHeight) };
+		const __m256 screenZ{ _mm256_div_ps(clipZ, clipW) };
+
+		// Vertex_Out is laid out per vertex, so the results are written out lane by lane
+		alignas(32) float results[7][BATCH_WIDTH];
+		alignas(32) int32_t laneFlags[BATCH_WIDTH];
+		const __m256 components[7]{
+			clipX, clipY, clipZ, clipW,
+			screenX, screenY, screenZ
+		};
+		for (int component{ 0 }; component < 7; ++component)
+		{
+			_mm256_store_ps(results[component], components[component]);
+		}
+		_mm256_store_si256(reinterpret_cast<__m256i*>(laneFlags), _mm256_castps_si256(flags));
+
+		for (int lane{ 0 }; lane < BATCH_WIDTH; ++lane)
+		{
+			const size_t index{ i + lane };
+
+			output.pClipPositions[index] = { results[0][lane], results[1][lane], results[2][lane], results[3][lane] };
+			output.pClipFlags[index] = static_cast<uint8_t>(laneFlags[lane]);
+			output.pVertices[index].position = { results[4][lane], results[5][lane], results[6][lane], results[3][lane] };
+		}
+	}
+
+	ToScreen_Scalar(setup, worldPositions, i, end, output);
+}
+
+TransformKernels::StageKernels TransformKernels::SelectStageKernels()
+{
+	if (SDL_HasAVX()) return { &ToWorld_AVX, &ToScreen_AVX };
+	return { &ToWorld_Scalar, &ToScreen_Scalar };
+}
+
+void TransformKernels::BuildVertexStreams(const std::vector<Vertex>& vertices, VertexStreams& streams)
+{
+	std::vector<float>* components[]{
+		&streams.positionX, &streams.positionY, &streams.positionZ,
+		&streams.normalX, &streams.normalY, &streams.normalZ,
+		&streams.tangentX, &streams.tangentY, &streams.tangentZ
+	};
+	for (std::vector<float>* pComponent : components)
+	{
+		pComponent->resize(vertices.size());
+	}
+
+	for (size_t i{ 0 }; i < vertices.size(); ++i)
+	{
+		const Vertex& vertex{ vertices[i] };
+		streams.positionX[i] = vertex.position.x;
+		streams.positionY[i] = vertex.position.y;
+		streams.positionZ[i] = vertex.position.z;
+		streams.normalX[i] = vertex.normal.x;
+		streams.normalY[i] = vertex.normal.y;
+		streams.normalZ[i] = vertex.normal.z;
+		streams.tangentX[i] = vertex.tangent.x;
+		streams.tangentY[i] = vertex.tangent.y;
+		streams.tangentZ[i] = vertex.tangent.z;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "DataTypes.h"
+#include "Maths.h"
+
+namespace dae
+{
+	namespace TransformKernels
+	{
+		constexpr int BATCH_WIDTH{ 8 };
+
+		// Per-mesh state of the screen transform, everything it depends on besides the world positions
+		struct ScreenSetup
+		{
+			Matrix viewProjection{};
+
+			float screenWidth{};
+			float screenHeight{};
+
+			float guardBandX{};
+			float guardBandY{};
+		};
+
+		struct TransformOutput
+		{
+			Vertex_Out* pVertices{};
+			Vector4* pClipPositions{};
+			uint8_t* pClipFlags{};
+
+			// Shader varyings of every vertex, written by the renderer once the kernels are done with them
+			float* pVaryings{};
+		};
+
+		// Moves positions of vertices [begin, end) to world space, and writes them to pVerticesOut along with their
+		// packed world space normal and tangent. Color and uv are copied over from pVertices.
+		using WorldKernel = void(*)(
+			const Matrix& world,
+			const VertexStreams& streams,
+			const Vertex* pVertices,
+			size_t begin,
+			size_t end,
+			PositionStreams& worldPositions,
+			Vertex_Out* pVerticesOut
+		);
+
+		// Transforms world positions [begin, end) to clip and screen space and computes their clip flags.
+		// Only the position of the output vertices is written.
+		using ScreenKernel = void(*)(
+			const ScreenSetup& setup,
+			const PositionStreams& worldPositions,
+			size_t begin,
+			size_t end,
+			const TransformOutput& output
+		);
+
+		void ToWorld_Scalar(const Matrix& world, const VertexStreams& streams, const Vertex* pVertices, size_t begin, size_t end, PositionStreams& worldPositions, Vertex_Out* pVerticesOut);
+		void ToWorld_AVX(const Matrix& world, const VertexStreams& streams, const Vertex* pVertices, size_t begin, size_t end, PositionStreams& worldPositions, Vertex_Out* pVerticesOut);
+
+		void ToScreen_Scalar(const ScreenSetup& setup, const PositionStreams& worldPositions, size_t begin, size_t end, const TransformOutput& output);
+		void ToScreen_AVX(const ScreenSetup& setup, const PositionStreams& worldPositions, size_t begin, size_t end, const TransformOutput& output);
+
+		struct StageKernels
+		{
+			WorldKernel toWorld{ &ToWorld_Scalar };
+			ScreenKernel toScreen{ &ToScreen_Scalar };
+		};
+
+		// Picks the widest kernels the CPU running the binary supports
+		StageKernels SelectStageKernels();
+
+		void BuildVertexStreams(const std::vector<Vertex>& vertices, VertexStreams& streams);
+	}
+}
@@ -86,6 +86,15 @@ int main(int argc, char* args[])
 				case SDL_SCANCODE_F7:
 					pRenderer->CycleShadingMode();
 					break;
+				case SDL_SCANCODE_F8:
+					pRenderer->CycleCullMode();
+					break;
+				case SDL_SCANCODE_F9:
+					pRenderer->ToggleVisibilityBuffer();
+					break;
+				case SDL_SCANCODE_F10:
+					pRenderer->CycleTextureFilter();
+					break;
 				default:
 					break;
 				}
@@ -106,6 +115,13 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
+
+			const Renderer::TriangleStats& stats{ pRenderer->GetTriangleStats() };
+			std::cout << "Triangles: " << stats.submitted << " submitted, " << stats.rasterized << " rasterized | culled: "
+				<< stats.frustumCulled << " frustum, " << stats.backfaceCulled << " backface, "
+				<< stats.degenerateCulled << " degenerate, " << stats.noCoverageCulled << " no coverage | meshes culled: "
+				<< stats.meshesCulled << " | meshlets culled: " << stats.meshletsFrustumCulled << " frustum, "
+				<< stats.meshletsBackfaceCulled << " backface" << std::endl;
 			benchmarkTotal += pTimer->GetdFPS();
 		}
 		if (benchmarkTimer >= 11.f)
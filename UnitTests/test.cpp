@@ -1,8 +1,541 @@
 #include "pch.h"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "SDL_cpuinfo.h"
+
 #include "../Library/src/Maths.h"
+#include "../Library/src/MeshOptimizer.h"
+#include "../Library/src/MeshSimplifier.h"
+#include "../Library/src/Utils.h"
+#include "../Library/src/VertexPacking.h"
+#include "../Rasterizer/src/TransformKernels.h"
 using namespace dae;
 
+namespace
+{
+	// (size + 1)^2 vertices on a wavy height field over [0, size]^2, two triangles per cell
+	Mesh CreateGrid(int size, float amplitude)
+	{
+		Mesh mesh{};
+		for (int y{ 0 }; y <= size; ++y)
+		{
+			for (int x{ 0 }; x <= size; ++x)
+			{
+				Vertex vertex{};
+				vertex.position = { static_cast<float>(x), amplitude * std::sin(x * 0.4f) * std::cos(y * 0.3f), static_cast<float>(y) };
+				vertex.uv = { static_cast<float>(x) / size, static_cast<float>(y) / size };
+				vertex.normal = Vector3::UnitY;
+				vertex.tangent = Vector3::UnitX;
+				mesh.vertices.push_back(vertex);
+			}
+		}
+
+		const auto index{ [size](int x, int y) { return static_cast<uint32_t>(y * (size + 1) + x); } };
+		for (int y{ 0 }; y < size; ++y)
+		{
+			for (int x{ 0 }; x < size; ++x)
+			{
+				mesh.indices.insert(mesh.indices.end(), { index(x, y), index(x, y + 1), index(x + 1, y) });
+				mesh.indices.insert(mesh.indices.end(), { index(x + 1, y), index(x, y + 1), index(x + 1, y + 1) });
+			}
+		}
+		return mesh;
+	}
+
+	// Latitude by longitude sphere of radius 1, with a seam of split vertices where the longitude wraps
+	Mesh CreateSphere(int latitudes, int longitudes)
+	{
+		Mesh mesh{};
+		for (int latitude{ 0 }; latitude <= latitudes; ++latitude)
+		{
+			const float theta{ PI * latitude / latitudes };
+			for (int longitude{ 0 }; longitude <= longitudes; ++longitude)
+			{
+				const float phi{ 2.f * PI * longitude / longitudes };
+
+				Vertex vertex{};
+				vertex.position = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+				vertex.uv = { static_cast<float>(longitude) / longitudes, static_cast<float>(latitude) / latitudes };
+				vertex.normal = vertex.position;
+				mesh.vertices.push_back(vertex);
+			}
+		}
+
+		const auto index{ [longitudes](int latitude, int longitude) { return static_cast<uint32_t>(latitude * (longitudes + 1) + longitude); } };
+		for (int latitude{ 0 }; latitude < latitudes; ++latitude)
+		{
+			for (int longitude{ 0 }; longitude < longitudes; ++longitude)
+			{
+				if (latitude > 0) mesh.indices.insert(mesh.indices.end(), { index(latitude, longitude), index(latitude, longitude + 1), index(latitude + 1, longitude) });
+				if (latitude < latitudes - 1) mesh.indices.insert(mesh.indices.end(), { index(latitude, longitude + 1), index(latitude + 1, longitude + 1), index(latitude + 1, longitude) });
+			}
+		}
+		return mesh;
+	}
+
+	// Rotated so the smallest index comes first, which keeps the winding comparable
+	std::vector<std::array<uint32_t, 3>> SortedTriangles(const std::vector<uint32_t>& indices)
+	{
+		std::vector<std::array<uint32_t, 3>> triangles{};
+		for (size_t i{ 0 }; i < indices.size(); i += 3)
+		{
+			std::array<uint32_t, 3> triangle{ indices[i], indices[i + 1], indices[i + 2] };
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// Rasterizes each triangle the way the tile kernels do and counts how often every pixel centre is covered
+	std::vector<int> CountCoverage(const std::vector<Vector2i>& positions, const std::vector<uint32_t>& indices, int width, int height)
+	{
+		std::vector<int> coverage(static_cast<size_t>(width) * height, 0);
+		for (size_t i{ 0 }; i < indices.size(); i += 3)
+		{
+			const Vector2i& v0{ positions[indices[i]] };
+			const Vector2i& v1{ positions[indices[i + 1]] };
+			const Vector2i& v2{ positions[indices[i + 2]] };
+
+			const GeometryUtils::TriangleEdges edges{ GeometryUtils::SetupTriangleEdges(v0, v1, v2) };
+			if (!edges.valid) continue;
+
+			const GeometryUtils::ScreenBoundingBox box{ GeometryUtils::GetScreenBoundingBox(v0, v1, v2, width, height) };
+			for (int py{ 0 }; py < height; ++py)
+			{
+				for (int px{ 0 }; px < width; ++px)
+				{
+					if (edges.e0.Evaluate(px, py) < 0 || edges.e1.Evaluate(px, py) < 0 || edges.e2.Evaluate(px, py) < 0) continue;
+
+					// Every covered pixel has to be inside the box the binner iterates
+					EXPECT_TRUE(px >= box.topLeft.x && px < box.bottomRight.x && py >= box.topLeft.y && py < box.bottomRight.y);
+					++coverage[static_cast<size_t>(py) * width + px];
+				}
+			}
+		}
+		return coverage;
+	}
+
+	// Closest distance from point to triangle abc, all in double
+	double PointTriangleDistance(const std::array<double, 3>& point, const std::array<double, 3>& a, const std::array<double, 3>& b, const std::array<double, 3>& c)
+	{
+		const auto sub{ [](const std::array<double, 3>& l, const std::array<double, 3>& r) { return std::array<double, 3>{ l[0] - r[0], l[1] - r[1], l[2] - r[2] }; } };
+		const auto dot{ [](const std::array<double, 3>& l, const std::array<double, 3>& r) { return l[0] * r[0] + l[1] * r[1] + l[2] * r[2]; } };
+		const auto length{ [&](const std::array<double, 3>& v) { return std::sqrt(dot(v, v)); } };
+		const auto segmentDistance{ [&](const std::array<double, 3>& from, const std::array<double, 3>& to)
+			{
+				const std::array<double, 3> edge{ sub(to, from) };
+				const double edgeLength{ dot(edge, edge) };
+				const double t{ edgeLength > 0.0 ? std::clamp(dot(sub(point, from), edge) / edgeLength, 0.0, 1.0) : 0.0 };
+				return length(sub(point, { from[0] + edge[0] * t, from[1] + edge[1] * t, from[2] + edge[2] * t }));
+			} };
+
+		const std::array<double, 3> ab{ sub(b, a) };
+		const std::array<double, 3> ac{ sub(c, a) };
+		const std::array<double, 3> normal{ ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+		const double normalLength{ length(normal) };
+
+		if (normalLength > 0.0)
+		{
+			// Inside the prism over the triangle the plane distance is the answer
+			const std::array<double, 3> ap{ sub(point, a) };
+			const std::array<double, 3> bp{ sub(point, b) };
+			const std::array<double, 3> cp{ sub(point, c) };
+			const auto side{ [&](const std::array<double, 3>& edge, const std::array<double, 3>& toPoint)
+				{
+					return dot(normal, { edge[1] * toPoint[2] - edge[2] * toPoint[1], edge[2] * toPoint[0] - edge[0] * toPoint[2], edge[0] * toPoint[1] - edge[1] * toPoint[0] });
+				} };
+			if (side(ab, ap) >= 0.0 && side(sub(c, b), bp) >= 0.0 && side(sub(a, c), cp) >= 0.0)
+			{
+				return std::abs(dot(ap, normal)) / normalLength;
+			}
+		}
+
+		return std::min(segmentDistance(a, b), std::min(segmentDistance(b, c), segmentDistance(c, a)));
+	}
+
+	std::array<double, 3> ToDouble(const Vector3& v)
+	{
+		return { v.x, v.y, v.z };
+	}
+
+	double AngleDegrees(const Vector3& original, const Vector3& decoded)
+	{
+		const std::array<double, 3> a{ ToDouble(original) };
+		const std::array<double, 3> b{ ToDouble(decoded) };
+		const double lengthA{ std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]) };
+		const double lengthB{ std::sqrt(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]) };
+		const double cosine{ (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]) / (lengthA * lengthB) };
+		return std::acos(std::clamp(cosine, -1.0, 1.0)) * 180.0 / 3.14159265358979323846;
+	}
+}
+
 TEST(Library, LinearAlgebraTests)
 {
 	EXPECT_EQ(Vector3::Cross(Vector3::UnitX, Vector3::UnitY), Vector3::UnitZ);
 }
+
+TEST(Rasterization, EdgeFunctionsMatchSubpixelEdges)
+{
+	using namespace GeometryUtils;
+
+	// Edge from (1, 1) to (3, 2) pixels, sign of E at a pixel centre has to match the exact subpixel cross product
+	const Vector2i from{ SUBPIXEL_SCALE, SUBPIXEL_SCALE };
+	const Vector2i to{ 3 * SUBPIXEL_SCALE, 2 * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2 };
+	for (const bool flip : { false, true })
+	{
+		const EdgeFunction edge{ SetupEdgeFunction(from, to, flip) };
+		for (int py{ -2 }; py < 6; ++py)
+		{
+			for (int px{ -2 }; px < 6; ++px)
+			{
+				const int64_t centreX{ static_cast<int64_t>(px) * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2 };
+				const int64_t centreY{ static_cast<int64_t>(py) * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2 };
+				int64_t exact{ (to.y - from.y) * (centreX - from.x) + (from.x - to.x) * (centreY - from.y) };
+				if (flip) exact = -exact;
+
+				if (exact != 0) EXPECT_EQ(edge.Evaluate(px, py) >= 0, exact > 0) << px << ", " << py;
+			}
+		}
+	}
+}
+
+TEST(Rasterization, TopLeftRuleCoversSharedEdgesOnce)
+{
+	using namespace GeometryUtils;
+
+	// Vertices on pixel centres, so horizontal, vertical and diagonal edges run straight through other pixel centres.
+	// The outline is fixed at centres 0.5 and 32.5, its top and left edges are drawn and its bottom and right edges aren't.
+	constexpr int cells{ 8 };
+	constexpr int cellSize{ 4 };
+	constexpr int extent{ cells * cellSize };
+	constexpr int bufferSize{ extent + 4 };
+
+	std::mt19937 generator{ 5 };
+	std::uniform_int_distribution<int> jitter{ -1, 1 };
+
+	std::vector<Vector2i> positions{};
+	for (int y{ 0 }; y <= cells; ++y)
+	{
+		for (int x{ 0 }; x <= cells; ++x)
+		{
+			const bool isBorder{ x == 0 || y == 0 || x == cells || y == cells };
+			const int pixelX{ x * cellSize + (isBorder ? 0 : jitter(generator)) };
+			const int pixelY{ y * cellSize + (isBorder ? 0 : jitter(generator)) };
+			positions.emplace_back(pixelX * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2, pixelY * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2);
+		}
+	}
+
+	// Alternating the diagonal and the winding exercises both edge directions and the flipped setup
+	std::vector<uint32_t> indices{};
+	for (uint32_t y{ 0 }; y < cells; ++y)
+	{
+		for (uint32_t x{ 0 }; x < cells; ++x)
+		{
+			const uint32_t i00{ y * (cells + 1) + x };
+			const uint32_t i10{ i00 + 1 };
+			const uint32_t i01{ i00 + cells + 1 };
+			const uint32_t i11{ i01 + 1 };
+			if ((x + y) % 2 == 0) indices.insert(indices.end(), { i00, i10, i11, i00, i01, i11 });
+			else indices.insert(indices.end(), { i00, i01, i10, i10, i11, i01 });
+		}
+	}
+
+	const std::vector<int> coverage{ CountCoverage(positions, indices, bufferSize, bufferSize) };
+	for (int py{ 0 }; py < bufferSize; ++py)
+	{
+		for (int px{ 0 }; px < bufferSize; ++px)
+		{
+			const int expected{ px < extent && py < extent ? 1 : 0 };
+			EXPECT_EQ(coverage[static_cast<size_t>(py) * bufferSize + px], expected) << px << ", " << py;
+		}
+	}
+}
+
+TEST(Rasterization, TopLeftRuleCoversFanOnce)
+{
+	using namespace GeometryUtils;
+
+	// Fan of random subpixel triangles around a shared centre, the polygon's inside has to be covered exactly once
+	constexpr int bufferSize{ 48 };
+	constexpr int segments{ 17 };
+
+	std::mt19937 generator{ 11 };
+	std::uniform_real_distribution<float> radius{ 12.f, 20.f };
+
+	const Vector2i centre{ 24 * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2, 24 * SUBPIXEL_SCALE };
+	std::vector<Vector2i> positions{ centre };
+	for (int i{ 0 }; i < segments; ++i)
+	{
+		const float angle{ 2.f * PI * i / segments };
+		const float distance{ radius(generator) };
+		positions.push_back(SnapToSubpixel({ 24.5f + std::cos(angle) * distance, 24.f + std::sin(angle) * distance, 0.f, 1.f }));
+	}
+
+	std::vector<uint32_t> indices{};
+	for (uint32_t i{ 0 }; i < segments; ++i)
+	{
+		indices.insert(indices.end(), { 0, i + 1, (i + 1) % segments + 1 });
+	}
+
+	const std::vector<int> coverage{ CountCoverage(positions, indices, bufferSize, bufferSize) };
+	for (int count : coverage)
+	{
+		EXPECT_LE(count, 1);
+	}
+
+	// Everything within the smallest radius is inside the polygon
+	for (int py{ 12 }; py < 36; ++py)
+	{
+		for (int px{ 12 }; px < 36; ++px)
+		{
+			const float dx{ px + 0.5f - 24.5f };
+			const float dy{ py + 0.5f - 24.f };
+			if (dx * dx + dy * dy < 10.f * 10.f) EXPECT_EQ(coverage[static_cast<size_t>(py) * bufferSize + px], 1) << px << ", " << py;
+		}
+	}
+}
+
+TEST(MeshOptimizer, ComputeACMR)
+{
+	// No reuse is 3 per triangle, a quad reuses its diagonal
+	EXPECT_FLOAT_EQ(MeshOptimizer::ComputeACMR({ 0, 1, 2, 3, 4, 5 }, 6), 3.f);
+	EXPECT_FLOAT_EQ(MeshOptimizer::ComputeACMR({ 0, 1, 2, 2, 1, 3 }, 4), 2.f);
+
+	// A vertex that fell out of the FIFO is transformed again
+	EXPECT_FLOAT_EQ(MeshOptimizer::ComputeACMR({ 0, 1, 2, 3, 4, 5, 0, 1, 2 }, 6, 3), 3.f);
+	EXPECT_FLOAT_EQ(MeshOptimizer::ComputeACMR({ 0, 1, 2, 3, 4, 5, 0, 1, 2 }, 6, 6), 2.f);
+}
+
+TEST(MeshOptimizer, OptimizeVertexCacheImprovesShuffledGrid)
+{
+	Mesh mesh{ CreateGrid(32, 0.f) };
+
+	// Shuffled triangles leave little for the cache to reuse
+	std::vector<std::array<uint32_t, 3>> triangles{};
+	for (size_t i{ 0 }; i < mesh.indices.size(); i += 3)
+	{
+		triangles.push_back({ mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] });
+	}
+	std::shuffle(triangles.begin(), triangles.end(), std::mt19937{ 3 });
+	mesh.indices.clear();
+	for (const std::array<uint32_t, 3>& triangle : triangles)
+	{
+		mesh.indices.insert(mesh.indices.end(), triangle.begin(), triangle.end());
+	}
+
+	const std::vector<uint32_t> original{ mesh.indices };
+	const float acmrBefore{ MeshOptimizer::ComputeACMR(mesh.indices, mesh.vertices.size()) };
+
+	MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+	const float acmrAfter{ MeshOptimizer::ComputeACMR(mesh.indices, mesh.vertices.size()) };
+
+	EXPECT_EQ(SortedTriangles(mesh.indices), SortedTriangles(original));
+	EXPECT_LT(acmrAfter, acmrBefore);
+	EXPECT_LT(acmrAfter, 0.8f);
+
+	// Running it again on its own output can't make it worse
+	MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+	EXPECT_LE(MeshOptimizer::ComputeACMR(mesh.indices, mesh.vertices.size()), acmrAfter);
+}
+
+TEST(MeshOptimizer, BuildMeshletsRespectsLimitsAndCones)
+{
+	Mesh mesh{ CreateSphere(24, 48) };
+	MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.vertices.size());
+
+	// Triangles by position, the meshlets duplicate vertices so their indices change
+	const auto positionTriangles{ [](const Mesh& source)
+		{
+			std::vector<std::array<float, 9>> triangles{};
+			for (size_t i{ 0 }; i < source.indices.size(); i += 3)
+			{
+				std::array<float, 9> triangle{};
+				for (int corner{ 0 }; corner < 3; ++corner)
+				{
+					const Vector3& position{ source.vertices[source.indices[i + corner]].position };
+					triangle[corner * 3 + 0] = position.x;
+					triangle[corner * 3 + 1] = position.y;
+					triangle[corner * 3 + 2] = position.z;
+				}
+				triangles.push_back(triangle);
+			}
+			std::sort(triangles.begin(), triangles.end());
+			return triangles;
+		} };
+	const std::vector<std::array<float, 9>> original{ positionTriangles(mesh) };
+
+	MeshOptimizer::BuildMeshlets(mesh);
+	ASSERT_FALSE(mesh.meshlets.empty());
+	EXPECT_EQ(positionTriangles(mesh), original);
+
+	uint32_t nextVertex{ 0 };
+	uint32_t nextIndex{ 0 };
+	size_t cullableCount{ 0 };
+	for (const Meshlet& meshlet : mesh.meshlets)
+	{
+		// Consecutive ranges that together cover the whole mesh
+		EXPECT_EQ(meshlet.vertexOffset, nextVertex);
+		EXPECT_EQ(meshlet.indexOffset, nextIndex);
+		nextVertex += meshlet.vertexCount;
+		nextIndex += meshlet.indexCount;
+
+		EXPECT_LE(meshlet.vertexCount, MeshOptimizer::MESHLET_MAX_VERTICES);
+		EXPECT_LE(meshlet.indexCount / 3, MeshOptimizer::MESHLET_MAX_TRIANGLES);
+		EXPECT_GT(meshlet.indexCount, 0u);
+
+		for (uint32_t i{ meshlet.vertexOffset }; i < meshlet.vertexOffset + meshlet.vertexCount; ++i)
+		{
+			const Vector3& position{ mesh.vertices[i].position };
+			EXPECT_TRUE(position.x >= meshlet.bounds.min.x && position.y >= meshlet.bounds.min.y && position.z >= meshlet.bounds.min.z);
+			EXPECT_TRUE(position.x <= meshlet.bounds.max.x && position.y <= meshlet.bounds.max.y && position.z <= meshlet.bounds.max.z);
+		}
+
+		if (meshlet.coneCutoff <= 1.f) ++cullableCount;
+		const float minDot{ std::sqrt(std::max(1.f - meshlet.coneCutoff * meshlet.coneCutoff, 0.f)) };
+
+		for (uint32_t i{ meshlet.indexOffset }; i < meshlet.indexOffset + meshlet.indexCount; i += 3)
+		{
+			for (int corner{ 0 }; corner < 3; ++corner)
+			{
+				EXPECT_GE(mesh.indices[i + corner], meshlet.vertexOffset);
+				EXPECT_LT(mesh.indices[i + corner], meshlet.vertexOffset + meshlet.vertexCount);
+			}
+
+			if (meshlet.coneCutoff > 1.f) continue;
+
+			const Vector3& p0{ mesh.vertices[mesh.indices[i + 0]].position };
+			const Vector3& p1{ mesh.vertices[mesh.indices[i + 1]].position };
+			const Vector3& p2{ mesh.vertices[mesh.indices[i + 2]].position };
+			const Vector3 normal{ Vector3::Cross(p1 - p0, p2 - p0) };
+			if (normal.SqrMagnitude() > 0.f) EXPECT_GE(Vector3::Dot(normal.Normalized(), meshlet.coneAxis), minDot - 1e-4f);
+		}
+	}
+	EXPECT_EQ(nextVertex, mesh.vertices.size());
+	EXPECT_EQ(nextIndex, mesh.indices.size());
+
+	// A sphere is curved gently enough that most meshlets get a usable cone
+	EXPECT_GT(cullableCount, mesh.meshlets.size() / 2);
+}
+
+TEST(MeshSimplifier, SimplifyStaysWithinReportedError)
+{
+	const Mesh mesh{ CreateGrid(24, 1.5f) };
+	const size_t targetIndexCount{ mesh.indices.size() / 4 / 3 * 3 };
+
+	float error{};
+	const std::vector<uint32_t> simplified{ MeshSimplifier::Simplify(mesh.vertices, mesh.indices, targetIndexCount, error) };
+
+	ASSERT_FALSE(simplified.empty());
+	EXPECT_EQ(simplified.size() % 3, 0u);
+	EXPECT_LE(simplified.size(), targetIndexCount);
+	EXPECT_GT(error, 0.f);
+
+	// Checked against every simplified triangle, the reported error only searches nearby ones so it may be larger
+	double maxDistance{ 0.0 };
+	for (const Vertex& vertex : mesh.vertices)
+	{
+		double distance{ DBL_MAX };
+		for (size_t i{ 0 }; i < simplified.size(); i += 3)
+		{
+			distance = std::min(distance, PointTriangleDistance(
+				ToDouble(vertex.position),
+				ToDouble(mesh.vertices[simplified[i + 0]].position),
+				ToDouble(mesh.vertices[simplified[i + 1]].position),
+				ToDouble(mesh.vertices[simplified[i + 2]].position)
+			));
+		}
+		maxDistance = std::max(maxDistance, distance);
+	}
+	EXPECT_LE(maxDistance, error * 1.0001 + 1e-5);
+
+	// A flat grid loses nothing
+	const Mesh flat{ CreateGrid(24, 0.f) };
+	float flatError{};
+	const std::vector<uint32_t> flatSimplified{ MeshSimplifier::Simplify(flat.vertices, flat.indices, targetIndexCount, flatError) };
+	EXPECT_LE(flatSimplified.size(), targetIndexCount);
+	EXPECT_NEAR(flatError, 0.f, 1e-5f);
+}
+
+TEST(VertexPacking, OctahedralRoundTripWithinBound)
+{
+	std::mt19937 generator{ 7 };
+	std::normal_distribution<float> component{ 0.f, 1.f };
+
+	std::vector<Vector3> directions{
+		Vector3::UnitX, Vector3::UnitY, Vector3::UnitZ, -Vector3::UnitX, -Vector3::UnitY, -Vector3::UnitZ,
+		{ 1.f, 1.f, 1.f }, { -1.f, 1.f, -1.f }, { 1.f, -1.f, 0.f }, { 0.f, 1.f, -1.f }
+	};
+	for (int i{ 0 }; i < 200000; ++i)
+	{
+		const Vector3 direction{ component(generator), component(generator), component(generator) };
+		if (direction.SqrMagnitude() > 1e-6f) directions.push_back(direction);
+	}
+
+	double maxAngle{ 0.0 };
+	for (const Vector3& direction : directions)
+	{
+		maxAngle = std::max(maxAngle, AngleDegrees(direction, UnpackOctahedral(PackOctahedral(direction))));
+	}
+	EXPECT_LE(maxAngle, 0.0037);
+
+	// Lengths don't matter, and directions without one decode to +z
+	EXPECT_EQ(PackOctahedral({ 0.f, 2.f, 0.f }), PackOctahedral(Vector3::UnitY));
+	EXPECT_EQ(UnpackOctahedral(PackOctahedral(Vector3::Zero)), Vector3::UnitZ);
+}
+
+TEST(TransformKernels, AVXPackingMatchesScalar)
+{
+	if (!SDL_HasAVX()) return;
+
+	// Not a multiple of the batch width, so the scalar tail runs too
+	constexpr size_t vertexCount{ 10003 };
+
+	std::mt19937 generator{ 13 };
+	std::normal_distribution<float> component{ 0.f, 1.f };
+
+	std::vector<Vertex> vertices(vertexCount);
+	for (size_t i{ 0 }; i < vertexCount; ++i)
+	{
+		vertices[i].position = { component(generator), component(generator), component(generator) };
+		vertices[i].normal = { component(generator), component(generator), component(generator) };
+		vertices[i].tangent = { component(generator), component(generator), component(generator) };
+	}
+
+	// Exact zeros and axis directions hit the sign and fold edge cases
+	vertices[0].normal = Vector3::Zero;
+	vertices[1].normal = -Vector3::UnitZ;
+	vertices[2].tangent = { 0.f, -0.f, -1.f };
+	vertices[3].normal = { -0.f, 0.f, 0.f };
+
+	VertexStreams streams{};
+	TransformKernels::BuildVertexStreams(vertices, streams);
+
+	for (const Matrix& world : { Matrix{}, Matrix::CreateRotation(0.3f, -1.1f, 2.f) * Matrix::CreateTranslation(1.f, 2.f, 3.f) })
+	{
+		PositionStreams scalarPositions{};
+		PositionStreams avxPositions{};
+		scalarPositions.Resize(vertexCount);
+		avxPositions.Resize(vertexCount);
+		std::vector<Vertex_Out> scalarOut(vertexCount);
+		std::vector<Vertex_Out> avxOut(vertexCount);
+
+		TransformKernels::ToWorld_Scalar(world, streams, vertices.data(), 0, vertexCount, scalarPositions, scalarOut.data());
+		TransformKernels::ToWorld_AVX(world, streams, vertices.data(), 0, vertexCount, avxPositions, avxOut.data());
+
+		for (size_t i{ 0 }; i < vertexCount; ++i)
+		{
+			ASSERT_EQ(avxOut[i].normal, scalarOut[i].normal) << i;
+			ASSERT_EQ(avxOut[i].tangent, scalarOut[i].tangent) << i;
+			ASSERT_EQ(avxPositions.x[i], scalarPositions.x[i]) << i;
+			ASSERT_EQ(avxPositions.y[i], scalarPositions.y[i]) << i;
+			ASSERT_EQ(avxPositions.z[i], scalarPositions.z[i]) << i;
+		}
+	}
+}